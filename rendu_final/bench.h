@@ -0,0 +1,152 @@
+//bench.h
+// Outils communs aux programmes de mesure (chatbench, fanoutbench) :
+// horloge monotone, histogramme de latences, connexion et échanges bloquants avec le serveur.
+// L'histogramme est log-linéaire : 16 sous-cases par puissance de deux, soit une précision d'environ 6 %,
+// pour quelques kilo-octets par histogramme et un enregistrement en O(1).
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+// Fonction pour lire l'horloge monotone en nanosecondes
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Fonction pour trouver la case de l'histogramme d'une durée en nanosecondes
+static int hist_bucket(unsigned long long value) {
+    if (value < HIST_SUB) {
+        return (int)value;
+    }
+    int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB + (int)((value >> shift) & (HIST_SUB - 1));
+}
+
+// Fonction pour retrouver la borne supérieure (incluse) d'une case de l'histogramme
+static unsigned long long hist_upper(int bucket) {
+    if (bucket < HIST_SUB) {
+        return bucket;
+    }
+    int shift = bucket / HIST_SUB - 1;
+    unsigned long long sub = bucket % HIST_SUB;
+    return ((HIST_SUB + sub + 1) << shift) - 1;
+}
+
+// Fonction pour calculer un quantile (0 < q <= 1) d'un histogramme ; 0 s'il est vide
+static unsigned long long hist_quantile(const unsigned long* hist, double q) {
+    unsigned long long total = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        total += hist[b];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    unsigned long long rank = (unsigned long long)(q * total + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    unsigned long long seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen >= rank) {
+            return hist_upper(b);
+        }
+    }
+    return hist_upper(HIST_BUCKETS - 1);
+}
+
+// Fonction pour ouvrir une connexion bloquante vers le serveur ; -1 en cas d'échec
+static int bench_connect(const char* host, const char* port) {
+    struct addrinfo hints, *result, *rp;
+    int sockfd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &result) != 0) {
+        return -1;
+    }
+    for (rp = result; rp != NULL; rp = rp->ai_next) {
+        sockfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+        if (sockfd == -1) continue;
+        if (connect(sockfd, rp->ai_addr, rp->ai_addrlen) != -1) break;
+        close(sockfd);
+        sockfd = -1;
+    }
+    freeaddrinfo(result);
+
+    if (sockfd != -1) {
+        int one = 1;
+        setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return sockfd;
+}
+
+// Fonction pour écrire entièrement len octets sur une socket bloquante
+static int write_all(int fd, const void* buf, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t ret = send(fd, (const char*)buf + sent, len - sent, MSG_NOSIGNAL);
+        if (ret <= 0) {
+            return -1;
+        }
+        sent += ret;
+    }
+    return 0;
+}
+
+// Fonction pour lire une trame sans charge utile sur une socket bloquante, en sautant les PING
+static int read_reply(int fd, struct message* msg) {
+    do {
+        size_t got = 0;
+        while (got < sizeof(struct message)) {
+            ssize_t ret = read(fd, (char*)msg + got, sizeof(struct message) - got);
+            if (ret <= 0) {
+                return -1;
+            }
+            got += ret;
+        }
+    } while (msg->type == PING);
+    return 0;
+}
+
+// Fonction pour connecter une session et l'identifier sous nickname ; -1 en cas d'échec
+static int bench_open_session(const char* host, const char* port, const char* nickname) {
+    int fd = bench_connect(host, port);
+    if (fd == -1) {
+        return -1;
+    }
+    struct message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = NICKNAME_NEW;
+    strncpy(msg.nick_sender, nickname, NICK_LEN - 1);
+    msg.pld_len = strlen(msg.nick_sender);
+    if (write_all(fd, &msg, sizeof(msg)) == -1 || read_reply(fd, &msg) == -1 || msg.type != NICKNAME_NEW) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Fonction pour relever la limite de descripteurs ouverts au maximum autorisé
+static void raise_fd_limit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) == -1) {
+            perror("setrlimit()");
+        }
+    }
+}
@@ -0,0 +1,674 @@
+//chatbench.c
+// Générateur de charge en boucle fermée pour le serveur de discussion
+// Ouvre des milliers de sessions (poignée de main NICKNAME_NEW, trames struct message) et leur fait
+// émettre un mélange de UNICAST_SEND, BROADCAST_SEND, MULTICAST_SEND, /who et join/quit à un débit cible.
+// Chaque message porte dans son texte l'indice de la session émettrice et l'instant d'envoi
+// (CLOCK_MONOTONIC) : le destinataire en déduit la latence de bout en bout.
+// Une session n'a qu'une opération en vol : elle redevient disponible à la première livraison
+// (ou à la réponse du serveur pour /who et join/quit), ou après --timeout ms.
+// Si aucune session n'est disponible, l'opération est comptée comme manquée : le débit obtenu
+// redescend sous la cible quand le serveur sature.
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "msg_struct.h"
+#include "bench.h"
+
+#define CHANNEL_LEN 32
+#define MSG_LEN 1024
+#define RX_CAP (16 * 1024)
+#define TX_CAP (4 * 1024)
+#define MAX_THREADS 64
+#define SESSIONS_PER_CHANNEL 20
+
+enum op_kind {
+    OP_UNICAST,
+    OP_BROADCAST,
+    OP_MULTICAST,
+    OP_WHO,
+    OP_JOINQUIT,
+    OP_KINDS,
+};
+
+static const char* op_kind_str[OP_KINDS] = {"unicast", "broadcast", "multicast", "who", "join/quit"};
+
+typedef struct Session {
+    int fd;
+    int index;
+    int home_channel;
+    int extra_channel;          // -1 si la session n'a rejoint aucun salon en plus du sien
+    long long extra_since_ns;   // acquittement du dernier MULTICAST_JOIN
+    _Atomic bool busy;          // remis à false par le thread qui observe la livraison
+    enum op_kind op;
+    _Atomic long long op_start_ns;  // lu par le thread du destinataire pour reconnaître l'opération
+    char home_name[CHANNEL_LEN];
+    size_t rx_len;
+    size_t tx_len;
+    bool want_out;
+    char rx[RX_CAP];
+    char tx[TX_CAP];
+} Session;
+
+typedef struct Stats {
+    unsigned long sent[OP_KINDS];
+    unsigned long delivered[OP_KINDS];
+    unsigned long timeouts;
+    unsigned long missed;
+    unsigned long closed;
+    unsigned long long bytes_in;
+    unsigned long hist[OP_KINDS][HIST_BUCKETS];
+} Stats;
+
+typedef struct Worker {
+    pthread_t thread;
+    int index;
+    int first;
+    int count;
+    int epfd;
+    uint64_t rng;
+    Stats stats;
+} Worker;
+
+// Paramètres de la mesure
+static const char* server_host;
+static const char* server_port;
+static int session_count = 1000;
+static int thread_count = 4;
+static int channel_count = 0;
+static double target_rate = 2000;
+static int duration_s = 10;
+static int warmup_s = 2;
+static int timeout_ms = 1000;
+static int payload_size = 64;
+static int mix[OP_KINDS] = {70, 1, 20, 4, 5};
+static int mix_total;
+static int run_id;
+
+static Session* sessions;
+static Worker workers[MAX_THREADS];
+static long long measure_start_ns;
+static long long measure_end_ns;
+
+// Fonction pour tirer un entier pseudo-aléatoire (xorshift64*)
+static uint64_t next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Fonction pour noter une livraison ; seules celles émises et reçues pendant la mesure comptent
+static void record_delivery(Worker* worker, enum op_kind op, long long sent_ns, long long now) {
+    if (sent_ns < measure_start_ns || now >= measure_end_ns || now < sent_ns) {
+        return;
+    }
+    worker->stats.delivered[op]++;
+    worker->stats.hist[op][hist_bucket(now - sent_ns)]++;
+}
+
+// Fonction pour composer le pseudo d'une session
+static void session_nickname(int index, char* out, size_t len) {
+    snprintf(out, len, "b%d_%d", run_id, index);
+}
+
+// Fonction pour composer le nom d'un salon
+static void channel_name(int channel, char* out, size_t len) {
+    snprintf(out, len, "c%d_%d", run_id, channel);
+}
+
+// Fonction pour écrire ce qui reste dans le tampon d'émission d'une session, sans bloquer
+// Retourne -1 si la connexion est perdue
+static int session_flush(Worker* worker, Session* session) {
+    size_t sent = 0;
+    while (sent < session->tx_len) {
+        ssize_t ret = send(session->fd, session->tx + sent, session->tx_len - sent, MSG_NOSIGNAL);
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (ret <= 0) {
+            return -1;
+        }
+        sent += ret;
+    }
+    memmove(session->tx, session->tx + sent, session->tx_len - sent);
+    session->tx_len -= sent;
+
+    bool want_out = session->tx_len > 0;
+    if (want_out != session->want_out) {
+        struct epoll_event ev = {.events = EPOLLIN | (want_out ? EPOLLOUT : 0), .data.ptr = session};
+        epoll_ctl(worker->epfd, EPOLL_CTL_MOD, session->fd, &ev);
+        session->want_out = want_out;
+    }
+    return 0;
+}
+
+// Fonction pour envoyer un message au format historique (en-tête, puis charge utile éventuelle)
+static int session_send(Worker* worker, Session* session, struct message* msg, const char* payload) {
+    size_t payload_len = payload ? (size_t)msg->pld_len : 0;
+    if (session->tx_len + sizeof(struct message) + payload_len > TX_CAP) {
+        return -1;
+    }
+    memcpy(session->tx + session->tx_len, msg, sizeof(struct message));
+    session->tx_len += sizeof(struct message);
+    if (payload_len > 0) {
+        memcpy(session->tx + session->tx_len, payload, payload_len);
+        session->tx_len += payload_len;
+    }
+    return session_flush(worker, session);
+}
+
+// Fonction pour fermer une session perdue ; elle ne participe plus à la charge
+static void session_close(Worker* worker, Session* session) {
+    if (session->fd == -1) {
+        return;
+    }
+    epoll_ctl(worker->epfd, EPOLL_CTL_DEL, session->fd, NULL);
+    close(session->fd);
+    session->fd = -1;
+    atomic_store(&session->busy, true);
+    worker->stats.closed++;
+}
+
+// Fonction pour remplir le texte d'un message de charge : "<session> <instant>" puis du bourrage
+static int fill_text(char* out, size_t cap, int index, long long sent_ns) {
+    int len = snprintf(out, cap, "%d %lld ", index, sent_ns);
+    int target = payload_size < (int)cap - 1 ? payload_size : (int)cap - 1;
+    while (len < target) {
+        out[len++] = 'x';
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Fonction pour tirer le type de la prochaine opération selon le mélange demandé
+static enum op_kind pick_op(Worker* worker) {
+    int r = (int)(next_random(&worker->rng) % mix_total);
+    for (int op = 0; op < OP_KINDS; op++) {
+        if (r < mix[op]) {
+            return op;
+        }
+        r -= mix[op];
+    }
+    return OP_UNICAST;
+}
+
+// Fonction pour lancer une opération depuis une session disponible
+static void start_op(Worker* worker, Session* session, enum op_kind op, long long now) {
+    struct message msg;
+    char text[MSG_LEN];
+    memset(&msg, 0, sizeof(msg));
+    session_nickname(session->index, msg.nick_sender, NICK_LEN);
+    const char* payload = NULL;
+
+    if (op == OP_UNICAST) {
+        int target = (int)(next_random(&worker->rng) % session_count);
+        if (target == session->index) {
+            target = (target + 1) % session_count;
+        }
+        msg.type = UNICAST_SEND;
+        session_nickname(target, msg.infos, INFOS_LEN);
+        msg.pld_len = fill_text(text, sizeof(text), session->index, now);
+        payload = text;
+    } else if (op == OP_BROADCAST) {
+        msg.type = BROADCAST_SEND;
+        fill_text(msg.infos, INFOS_LEN, session->index, now);
+    } else if (op == OP_MULTICAST) {
+        msg.type = MULTICAST_SEND;
+        strncpy(msg.infos, session->home_name, CHANNEL_LEN - 1);
+        msg.pld_len = fill_text(text, sizeof(text), session->index, now);
+        payload = text;
+    } else if (op == OP_WHO) {
+        msg.type = NICKNAME_LIST;
+    } else if (session->extra_channel == -1) {
+        // Un salon autre que le sien, qu'on quittera à la prochaine opération join/quit
+        int channel = (int)(next_random(&worker->rng) % channel_count);
+        if (channel == session->home_channel) {
+            channel = (channel + 1) % channel_count;
+        }
+        if (channel == session->home_channel) {
+            return;
+        }
+        msg.type = MULTICAST_JOIN;
+        channel_name(channel, msg.infos, CHANNEL_LEN);
+        session->extra_channel = channel;
+    } else {
+        msg.type = MULTICAST_QUIT;
+        channel_name(session->extra_channel, msg.infos, CHANNEL_LEN);
+        session->extra_channel = -1;
+    }
+
+    atomic_store(&session->busy, true);
+    session->op = op;
+    session->op_start_ns = now;
+    if (now >= measure_start_ns && now < measure_end_ns) {
+        worker->stats.sent[op]++;
+    }
+    if (session_send(worker, session, &msg, payload) == -1) {
+        session_close(worker, session);
+    }
+}
+
+// Fonction pour extraire l'émetteur et l'instant d'envoi d'un texte de charge
+static bool parse_text(const char* text, int* index, long long* sent_ns) {
+    char* end;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end != ' ' || value < 0 || value >= session_count) {
+        return false;
+    }
+    *index = (int)value;
+    *sent_ns = strtoll(end + 1, &end, 10);
+    return *end == ' ' || *end == '\0';
+}
+
+// Fonction pour traiter une livraison portant un texte de charge
+static void handle_delivery(Worker* worker, enum op_kind op, const char* text, long long now) {
+    int sender;
+    long long sent_ns;
+    if (!parse_text(text, &sender, &sent_ns)) {
+        return;
+    }
+    record_delivery(worker, op, sent_ns, now);
+    // La première livraison libère l'émetteur, quel que soit le thread qui le gère
+    Session* origin = &sessions[sender];
+    if (atomic_load(&origin->op_start_ns) == sent_ns) {
+        atomic_store(&origin->busy, false);
+    }
+}
+
+// Fonction pour traiter une trame reçue par une session
+static void handle_frame(Worker* worker, Session* session, struct message* msg, char* payload, long long now) {
+    if (msg->type == PING) {
+        struct message pong_msg;
+        memset(&pong_msg, 0, sizeof(pong_msg));
+        pong_msg.type = PONG;
+        if (session_send(worker, session, &pong_msg, NULL) == -1) {
+            session_close(worker, session);
+        }
+    } else if (msg->type == UNICAST_SEND) {
+        handle_delivery(worker, OP_UNICAST, payload, now);
+    } else if (msg->type == BROADCAST_SEND) {
+        handle_delivery(worker, OP_BROADCAST, msg->infos, now);
+    } else if (msg->type == MULTICAST_SEND) {
+        // Après un MULTICAST_JOIN, le serveur rejoue l'historique du salon : ces messages-là
+        // ne sont pas des livraisons et fausseraient la latence
+        int sender;
+        long long sent_ns;
+        if (strcmp(msg->infos, session->home_name) != 0 && parse_text(payload, &sender, &sent_ns) && sent_ns < session->extra_since_ns) {
+            return;
+        }
+        handle_delivery(worker, OP_MULTICAST, payload, now);
+    } else if (atomic_load(&session->busy) &&
+               ((msg->type == NICKNAME_LIST && session->op == OP_WHO) ||
+                ((msg->type == MULTICAST_JOIN || msg->type == MULTICAST_QUIT) && session->op == OP_JOINQUIT))) {
+        // Réponse du serveur à une requête de la session elle-même
+        if (msg->type == MULTICAST_JOIN) {
+            session->extra_since_ns = now;
+        }
+        record_delivery(worker, session->op, session->op_start_ns, now);
+        atomic_store(&session->busy, false);
+    }
+}
+
+// Fonction pour savoir si une trame du serveur est suivie d'une charge utile (format historique)
+static bool server_frame_has_payload(enum msg_type type) {
+    return type == UNICAST_SEND || type == MULTICAST_SEND || type == FILE_REQUEST;
+}
+
+// Fonction pour lire tout ce qui est disponible sur une session et traiter les trames complètes
+static void session_readable(Worker* worker, Session* session) {
+    while (session->fd != -1) {
+        ssize_t ret = recv(session->fd, session->rx + session->rx_len, RX_CAP - session->rx_len, 0);
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (ret <= 0) {
+            session_close(worker, session);
+            return;
+        }
+        session->rx_len += ret;
+        long long now = now_ns();
+        if (now >= measure_start_ns && now < measure_end_ns) {
+            worker->stats.bytes_in += ret;
+        }
+
+        size_t pos = 0;
+        while (session->fd != -1 && session->rx_len - pos >= sizeof(struct message)) {
+            struct message msg;
+            char payload[MSG_LEN];
+            memcpy(&msg, session->rx + pos, sizeof(msg));
+            msg.infos[INFOS_LEN - 1] = '\0';
+            size_t frame_len = sizeof(struct message);
+            payload[0] = '\0';
+            if (server_frame_has_payload(msg.type) && msg.pld_len > 0) {
+                if (msg.pld_len >= MSG_LEN) {
+                    session_close(worker, session);
+                    return;
+                }
+                if (session->rx_len - pos < frame_len + msg.pld_len) {
+                    break;
+                }
+                memcpy(payload, session->rx + pos + frame_len, msg.pld_len);
+                payload[msg.pld_len] = '\0';
+                frame_len += msg.pld_len;
+            }
+            pos += frame_len;
+            handle_frame(worker, session, &msg, payload, now);
+        }
+        if (session->fd == -1) {
+            return;
+        }
+        memmove(session->rx, session->rx + pos, session->rx_len - pos);
+        session->rx_len -= pos;
+    }
+}
+
+// Fonction pour choisir une session disponible parmi celles du thread ; NULL si toutes sont occupées
+static Session* pick_idle_session(Worker* worker) {
+    int start = (int)(next_random(&worker->rng) % worker->count);
+    for (int i = 0; i < worker->count; i++) {
+        Session* session = &sessions[worker->first + (start + i) % worker->count];
+        if (session->fd != -1 && !atomic_load(&session->busy)) {
+            return session;
+        }
+    }
+    return NULL;
+}
+
+// Fonction pour libérer les sessions dont l'opération n'a reçu aucune réponse à temps
+static void expire_ops(Worker* worker, long long now) {
+    long long limit = now - timeout_ms * 1000000LL;
+    for (int i = 0; i < worker->count; i++) {
+        Session* session = &sessions[worker->first + i];
+        if (session->fd != -1 && atomic_load(&session->busy) && session->op_start_ns < limit) {
+            if (session->op_start_ns >= measure_start_ns && session->op_start_ns < measure_end_ns) {
+                worker->stats.timeouts++;
+            }
+            atomic_store(&session->busy, false);
+        }
+    }
+}
+
+// Fonction exécutée par chaque thread : cadence les opérations et lit les réponses de ses sessions
+static void* worker_thread(void* arg) {
+    Worker* worker = arg;
+    double rate = target_rate / thread_count;
+    long long start = now_ns();
+    long long stop = measure_end_ns + 500000000LL;
+    long long next_expire = start;
+    unsigned long long issued = 0;
+    struct epoll_event events[256];
+
+    for (long long now = start; now < stop; now = now_ns()) {
+        // Opérations dues depuis le début, au débit cible ; on n'émet plus après la mesure
+        if (now < measure_end_ns) {
+            unsigned long long due = (unsigned long long)((now - start) * rate / 1e9);
+            while (issued < due) {
+                issued++;
+                Session* session = pick_idle_session(worker);
+                if (!session) {
+                    if (now >= measure_start_ns) {
+                        worker->stats.missed++;
+                    }
+                    continue;
+                }
+                start_op(worker, session, pick_op(worker), now);
+            }
+        }
+        if (now >= next_expire) {
+            expire_ops(worker, now);
+            next_expire = now + 100000000LL;
+        }
+
+        int n = epoll_wait(worker->epfd, events, 256, 1);
+        for (int i = 0; i < n; i++) {
+            Session* session = events[i].data.ptr;
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                session_readable(worker, session);
+            }
+            if (session->fd != -1 && (events[i].events & EPOLLOUT)) {
+                if (session_flush(worker, session) == -1) {
+                    session_close(worker, session);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+// Fonction pour connecter et identifier une session, puis lui faire créer ou rejoindre son salon
+// Les créateurs attendent leur acquittement : les salons existent avant que les autres ne les rejoignent
+static void open_session(Session* session, int index) {
+    struct message msg;
+    memset(session, 0, sizeof(Session));
+    session->index = index;
+    session->extra_channel = -1;
+    session->home_channel = index % channel_count;
+    channel_name(session->home_channel, session->home_name, CHANNEL_LEN);
+    char nickname[NICK_LEN];
+    session_nickname(index, nickname, NICK_LEN);
+    session->fd = bench_open_session(server_host, server_port, nickname);
+    if (session->fd == -1) {
+        fprintf(stderr, "Échec de la connexion ou de l'identification de la session %d\n", index);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = index < channel_count ? MULTICAST_CREATE : MULTICAST_JOIN;
+    strncpy(msg.infos, session->home_name, CHANNEL_LEN - 1);
+    if (write_all(session->fd, &msg, sizeof(msg)) == -1) {
+        fprintf(stderr, "Échec de l'entrée dans le salon de la session %d\n", index);
+        exit(EXIT_FAILURE);
+    }
+    if (index < channel_count && (read_reply(session->fd, &msg) == -1 || msg.type != MULTICAST_CREATE)) {
+        fprintf(stderr, "Impossible de créer le salon de la session %d\n", index);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Fonction pour lire le mélange "unicast,broadcast,multicast,who,join/quit" (poids entiers)
+static bool parse_mix(const char* arg) {
+    int values[OP_KINDS];
+    const char* p = arg;
+    for (int op = 0; op < OP_KINDS; op++) {
+        char* end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value < 0) {
+            return false;
+        }
+        values[op] = (int)value;
+        p = end;
+        if (op < OP_KINDS - 1) {
+            if (*p != ',') {
+                return false;
+            }
+            p++;
+        }
+    }
+    if (*p != '\0') {
+        return false;
+    }
+    memcpy(mix, values, sizeof(mix));
+    return true;
+}
+
+// Fonction pour afficher le résultat agrégé de tous les threads
+static void print_report(double elapsed_s) {
+    Stats total;
+    memset(&total, 0, sizeof(total));
+    for (int t = 0; t < thread_count; t++) {
+        Stats* s = &workers[t].stats;
+        for (int op = 0; op < OP_KINDS; op++) {
+            total.sent[op] += s->sent[op];
+            total.delivered[op] += s->delivered[op];
+            for (int b = 0; b < HIST_BUCKETS; b++) {
+                total.hist[op][b] += s->hist[op][b];
+            }
+        }
+        total.timeouts += s->timeouts;
+        total.missed += s->missed;
+        total.closed += s->closed;
+        total.bytes_in += s->bytes_in;
+    }
+
+    unsigned long all_sent = 0;
+    unsigned long all_delivered = 0;
+    unsigned long all_hist[HIST_BUCKETS] = {0};
+    printf("chatbench : %d sessions, %d salons, %d threads, cible %.0f op/s, %.1f s mesurées\n",
+           session_count, channel_count, thread_count, target_rate, elapsed_s);
+    printf("%-10s %10s %12s %10s %10s %10s %10s\n", "type", "envoyés", "livraisons", "p50 (us)", "p99 (us)", "p99.9 (us)", "max (us)");
+    for (int op = 0; op < OP_KINDS; op++) {
+        printf("%-10s %10lu %12lu %10.1f %10.1f %10.1f %10.1f\n", op_kind_str[op], total.sent[op], total.delivered[op],
+               hist_quantile(total.hist[op], 0.50) / 1e3, hist_quantile(total.hist[op], 0.99) / 1e3,
+               hist_quantile(total.hist[op], 0.999) / 1e3, hist_quantile(total.hist[op], 1.0) / 1e3);
+        all_sent += total.sent[op];
+        all_delivered += total.delivered[op];
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            all_hist[b] += total.hist[op][b];
+        }
+    }
+    printf("%-10s %10lu %12lu %10.1f %10.1f %10.1f %10.1f\n", "total", all_sent, all_delivered,
+           hist_quantile(all_hist, 0.50) / 1e3, hist_quantile(all_hist, 0.99) / 1e3,
+           hist_quantile(all_hist, 0.999) / 1e3, hist_quantile(all_hist, 1.0) / 1e3);
+    printf("débit : %.0f op/s émises, %.0f livraisons/s, %.1f Mo/s reçus\n",
+           all_sent / elapsed_s, all_delivered / elapsed_s, total.bytes_in / elapsed_s / 1e6);
+    printf("opérations manquées (aucune session libre) : %lu, sans réponse après %d ms : %lu, sessions fermées : %lu\n",
+           total.missed, timeout_ms, total.timeouts, total.closed);
+}
+
+int main(int argc, char* argv[]) {
+    static const struct option long_options[] = {
+        {"sessions", required_argument, NULL, 'n'},
+        {"threads", required_argument, NULL, 't'},
+        {"channels", required_argument, NULL, 'c'},
+        {"rate", required_argument, NULL, 'r'},
+        {"duration", required_argument, NULL, 'd'},
+        {"warmup", required_argument, NULL, 'w'},
+        {"timeout", required_argument, NULL, 'T'},
+        {"size", required_argument, NULL, 's'},
+        {"mix", required_argument, NULL, 'm'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    bool bad = false;
+    while ((opt = getopt_long(argc, argv, "n:t:c:r:d:w:T:s:m:", long_options, NULL)) != -1) {
+        if (opt == 'n' && atoi(optarg) > 1) {
+            session_count = atoi(optarg);
+        } else if (opt == 't' && atoi(optarg) > 0 && atoi(optarg) <= MAX_THREADS) {
+            thread_count = atoi(optarg);
+        } else if (opt == 'c' && atoi(optarg) > 0) {
+            channel_count = atoi(optarg);
+        } else if (opt == 'r' && atof(optarg) > 0) {
+            target_rate = atof(optarg);
+        } else if (opt == 'd' && atoi(optarg) > 0) {
+            duration_s = atoi(optarg);
+        } else if (opt == 'w' && atoi(optarg) >= 0) {
+            warmup_s = atoi(optarg);
+        } else if (opt == 'T' && atoi(optarg) > 0) {
+            timeout_ms = atoi(optarg);
+        } else if (opt == 's' && atoi(optarg) > 0 && atoi(optarg) < MSG_LEN) {
+            payload_size = atoi(optarg);
+        } else if (opt == 'm' && parse_mix(optarg)) {
+            // mélange déjà enregistré
+        } else {
+            bad = true;
+        }
+    }
+    if (bad || optind != argc - 2) {
+        fprintf(stderr, "Utilisation : %s [--sessions N] [--threads N] [--channels N] [--rate op/s] [--duration s] [--warmup s] "
+                        "[--timeout ms] [--size octets] [--mix u,b,m,w,j] <hôte> <port>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    server_host = argv[optind];
+    server_port = argv[optind + 1];
+    for (int op = 0; op < OP_KINDS; op++) {
+        mix_total += mix[op];
+    }
+    if (mix_total == 0) {
+        fprintf(stderr, "Le mélange d'opérations est vide.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (channel_count == 0) {
+        channel_count = session_count / SESSIONS_PER_CHANNEL > 0 ? session_count / SESSIONS_PER_CHANNEL : 1;
+    }
+    if (channel_count > session_count) {
+        channel_count = session_count;
+    }
+    if (thread_count > session_count) {
+        thread_count = session_count;
+    }
+    run_id = getpid() % 100000;
+
+    raise_fd_limit();
+    sessions = calloc(session_count, sizeof(Session));
+    if (!sessions) {
+        perror("Échec d'allocation mémoire pour les sessions");
+        exit(EXIT_FAILURE);
+    }
+    long long setup_start = now_ns();
+    for (int i = 0; i < session_count; i++) {
+        open_session(&sessions[i], i);
+    }
+    printf("%d sessions ouvertes en %.2f s\n", session_count, (now_ns() - setup_start) / 1e9);
+
+    for (int t = 0; t < thread_count; t++) {
+        Worker* worker = &workers[t];
+        worker->index = t;
+        worker->first = (int)((long long)session_count * t / thread_count);
+        worker->count = (int)((long long)session_count * (t + 1) / thread_count) - worker->first;
+        worker->rng = 0x9E3779B97F4A7C15ULL * (t + 1) + run_id;
+        worker->epfd = epoll_create1(0);
+        if (worker->epfd == -1) {
+            perror("epoll_create1()");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < worker->count; i++) {
+            Session* session = &sessions[worker->first + i];
+            int flags = fcntl(session->fd, F_GETFL, 0);
+            fcntl(session->fd, F_SETFL, flags | O_NONBLOCK);
+            struct epoll_event ev = {.events = EPOLLIN, .data.ptr = session};
+            epoll_ctl(worker->epfd, EPOLL_CTL_ADD, session->fd, &ev);
+        }
+    }
+
+    measure_start_ns = now_ns() + warmup_s * 1000000000LL;
+    measure_end_ns = measure_start_ns + duration_s * 1000000000LL;
+    for (int t = 0; t < thread_count; t++) {
+        if (pthread_create(&workers[t].thread, NULL, worker_thread, &workers[t]) != 0) {
+            perror("pthread_create()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int t = 0; t < thread_count; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+
+    print_report(duration_s);
+    for (int i = 0; i < session_count; i++) {
+        if (sessions[i].fd != -1) {
+            close(sessions[i].fd);
+        }
+    }
+    free(sessions);
+    exit(EXIT_SUCCESS);
+}
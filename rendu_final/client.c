@@ -7,10 +7,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include "common.h"
 #include "msg_struct.h"
+#include "codec.h"
+#include "wire.h"
 
 #define MSG_LEN 1024
 
@@ -19,67 +23,68 @@ char created_channel[INFOS_LEN] = {'\0'};
 
 char pseudo[NICK_LEN] = {0};
 bool hasNickname = false;
+int proto = PROTO_LEGACY;
+
+// Fonction pour savoir si une trame du serveur est suivie d'une charge utile (format historique)
+bool server_frame_has_payload(enum msg_type type) {
+    return type == UNICAST_SEND || type == MULTICAST_SEND || type == FILE_REQUEST;
+}
 
 // Fonction pour envoyer un message complet au serveur
+// La charge utile (msg->pld_len octets) n'est envoyée que si payload n'est pas NULL
 ssize_t send_full_message(int server_fd, struct message* msg, const char* payload) {
-    ssize_t total_sent = 0;
-    ssize_t ret;
-    int message_size = sizeof(struct message);
-
-    while (total_sent != message_size) {
-        ret = write(server_fd, (char *)msg + total_sent, message_size - total_sent);
-        if (ret == -1) {
-            perror("write");
+    size_t payload_len = (msg->pld_len > 0 && payload != NULL) ? msg->pld_len : 0;
+
+    if (proto == PROTO_COMPACT) {
+        char frame[COMPACT_MAX_FRAME];
+        size_t len = compact_encode(msg, payload, payload_len, frame);
+        if (len == 0) {
+            fprintf(stderr, "Message trop long.\n");
             return -1;
         }
-        total_sent += ret;
+        struct iovec iov = { .iov_base = frame, .iov_len = len };
+        return writev_all(server_fd, &iov, 1);
     }
 
-    if (msg->pld_len > 0 && payload != NULL) {
-        ssize_t payload_sent = 0;
-        while (payload_sent != msg->pld_len) {
-            ret = write(server_fd, payload + payload_sent, msg->pld_len - payload_sent);
-            if (ret == -1) {
-                perror("write payload");
-                return -1;
-            }
-            payload_sent += ret;
+    // En-tête et charge utile partent ensemble : un seul appel système, un seul segment TCP
+    return send_legacy_message(server_fd, msg, payload);
+}
+
+// Fonction pour recevoir une trame du serveur
+// payload (MSG_LEN octets) reçoit la charge utile éventuelle, terminée par '\0'
+ssize_t receive_frame(int client_fd, struct message* msg, char* payload) {
+    payload[0] = '\0';
+
+    if (proto == PROTO_COMPACT) {
+        char frame[COMPACT_MAX_FRAME];
+        if (read_all(client_fd, frame, 2) == -1) {
+            return -1;
+        }
+        size_t len = compact_frame_len(frame);
+        if (len < COMPACT_HEADER_LEN || len > COMPACT_MAX_FRAME || read_all(client_fd, frame + 2, len - 2) == -1) {
+            return -1;
+        }
+        if (compact_decode(frame, len, msg, payload) < 0) {
+            return -1;
         }
-        total_sent += payload_sent;
+        return len;
     }
 
-    return total_sent;
+    return receive_legacy_message(client_fd, msg, payload, MSG_LEN, server_frame_has_payload);
 }
 
 // Fonction pour recevoir un message complet du serveur
+// Les PING du serveur (keepalive) reçoivent leur PONG ici ; le message PING est tout de même
+// rendu à l'appelant, qui l'ignore
 ssize_t receive_full_message(int client_fd, struct message* msg, char* payload) {
-    ssize_t total_received = 0;
-    ssize_t ret;
-    int message_size = sizeof(struct message);
-
-    while (total_received != message_size) {
-        ret = read(client_fd, (char *)msg + total_received, message_size - total_received);
-        if (ret == -1) {
-            perror("read");
-            return -1;
-        }
-        total_received += ret;
-    }
-
-    if (msg->pld_len > 0 && payload != NULL) {
-        ssize_t payload_received = 0;
-        while (payload_received != msg->pld_len) {
-            ret = read(client_fd, payload + payload_received, msg->pld_len - payload_received);
-            if (ret == -1) {
-                perror("read payload");
-                return -1;
-            }
-            payload_received += ret;
-        }
-        total_received += payload_received;
+    ssize_t ret = receive_frame(client_fd, msg, payload);
+    if (ret > 0 && msg->type == PING) {
+        struct message pong_msg;
+        memset(&pong_msg, 0, sizeof(pong_msg));
+        pong_msg.type = PONG;
+        send_full_message(client_fd, &pong_msg, NULL);
     }
-
-    return total_received;
+    return ret;
 }
 
 // Fonction pour générer l'invite de commande
@@ -120,6 +125,10 @@ int handle_connect(char* server_name, char* server_port) {
     }
 
     freeaddrinfo(result);
+
+    // Chaque message part en une seule écriture : inutile d'attendre l'algorithme de Nagle
+    int one = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
     return sockfd;
 }
 
@@ -143,12 +152,31 @@ void handle_identification(int sockfd) {
             strncpy(pseudo, buff + 6, NICK_LEN - 1);
             hasNickname = true;
 
+            memset(&msgstruct, 0, sizeof(msgstruct));
             msgstruct.pld_len = strlen(pseudo);
             strncpy(msgstruct.nick_sender, pseudo, NICK_LEN - 1);
             msgstruct.type = NICKNAME_NEW;
-            msgstruct.infos[0] = '\0';
+            // Demande du format compact ; un serveur plus ancien ignore ce champ
+            strncpy(msgstruct.infos, PROTO_COMPACT_HELLO, INFOS_LEN - 1);
+
+            send_full_message(sockfd, &msgstruct, NULL);
 
-            send(sockfd, &msgstruct, sizeof(msgstruct), 0);
+            // L'acquittement arrive toujours au format historique
+            if (receive_full_message(sockfd, &msgstruct, buff) == -1) {
+                perror("Le serveur s'est déconnecté ou une erreur est survenue");
+                exit(EXIT_FAILURE);
+            }
+            if (msgstruct.type == NICKNAME_DOUBLON) {
+                printf("Le pseudonyme %s est déjà pris par un autre utilisateur.\n", pseudo);
+                close(sockfd);
+                exit(EXIT_FAILURE);
+            }
+            if (msgstruct.type == NICKNAME_NEW) {
+                printf("Votre pseudonyme est désormais : %s\n", msgstruct.infos);
+                if (msgstruct.pld_len == PROTO_COMPACT) {
+                    proto = PROTO_COMPACT;
+                }
+            }
         } else {
             printf("Commande invalide. Veuillez entrer votre pseudo avec la commande /nick : ");
         }
@@ -158,19 +186,20 @@ void handle_identification(int sockfd) {
 // Fonction pour gérer la réponse du serveur à la commande /who
 void handle_who_response(int sockfd) {
     struct message msgstruct;
+    char payload[MSG_LEN];
 
     struct message who_request;
+    memset(&who_request, 0, sizeof(who_request));
     who_request.type = NICKNAME_LIST;
-    who_request.pld_len = 0;
-    who_request.nick_sender[0] = '\0';
-    who_request.infos[0] = '\0';
 
-    send(sockfd, &who_request, sizeof(who_request), 0);
+    send_full_message(sockfd, &who_request, NULL);
 
-    if (recv(sockfd, &msgstruct, sizeof(msgstruct), 0) <= 0) {
-        perror("Le serveur s'est déconnecté ou une erreur est survenue");
-        return;
-    }
+    do {
+        if (receive_full_message(sockfd, &msgstruct, payload) <= 0) {
+            perror("Le serveur s'est déconnecté ou une erreur est survenue");
+            return;
+        }
+    } while (msgstruct.type == PING);
 
     if (msgstruct.type == NICKNAME_LIST) {
 
@@ -195,7 +224,7 @@ void handle_whois_request(int sockfd, const char* target_user) {
     msg.pld_len = strlen(target_user);
     strncpy(msg.nick_sender, pseudo, NICK_LEN - 1);
     strncpy(msg.infos, target_user, INFOS_LEN - 1);
-    ssize_t bytes_sent = send(sockfd, &msg, sizeof(struct message), 0);
+    ssize_t bytes_sent = send_full_message(sockfd, &msg, NULL);
     if (bytes_sent == -1) {
         perror("Failed to send whois request");
     }
@@ -209,8 +238,7 @@ void handle_private_message(int sockfd, const char* target, const char* message)
     strncpy(msgstruct.nick_sender, pseudo, NICK_LEN - 1);
     msgstruct.type = UNICAST_SEND;
     strncpy(msgstruct.infos, target, NICK_LEN - 1); 
-    send(sockfd, &msgstruct, sizeof(msgstruct), 0);
-    send(sockfd, message, msgstruct.pld_len, 0);
+    send_full_message(sockfd, &msgstruct, message);
 }
 
 // Fonction pour envoyer une demande de création de salon au serveur
@@ -221,7 +249,7 @@ void send_multicast_create_message(int sockfd, const char* channel_name) {
     strncpy(msg.infos, channel_name, INFOS_LEN - 1);
     msg.infos[INFOS_LEN - 1] = '\0'; 
 
-    if (send(sockfd, &msg, sizeof(struct message), 0) < 0) {
+    if (send_full_message(sockfd, &msg, NULL) < 0) {
         perror("Erreur lors de l'envoi de la demande de création de salon");
     }
 }
@@ -233,7 +261,7 @@ void send_multicast_quit_message(int sockfd, const char* channel_name) {
     msg.type = MULTICAST_QUIT;
     strncpy(msg.infos, channel_name, INFOS_LEN - 1);
 
-    if (send(sockfd, &msg, sizeof(msg), 0) < 0) {
+    if (send_full_message(sockfd, &msg, NULL) < 0) {
         perror("Erreur lors de l'envoi de la demande de quitter le salon");
     }
 }
@@ -245,11 +273,25 @@ void send_multicast_join_message(int sockfd, const char* channel_name) {
     msg.type = MULTICAST_JOIN;
     strncpy(msg.infos, channel_name, INFOS_LEN - 1);
 
-    if (send(sockfd, &msg, sizeof(msg), 0) < 0) {
+    if (send_full_message(sockfd, &msg, NULL) < 0) {
         perror("Erreur lors de l'envoi de la demande de rejoindre le salon");
     }
 }
 
+// Fonction pour demander au serveur les derniers messages d'un salon
+// skip (charge utile, en décimal) : nombre de messages récents à sauter pour remonter plus loin
+void send_multicast_history_message(int sockfd, const char* channel_name, const char* skip) {
+    struct message msg;
+    memset(&msg, 0, sizeof(struct message));
+    msg.type = MULTICAST_HISTORY;
+    strncpy(msg.infos, channel_name, INFOS_LEN - 1);
+    msg.pld_len = strlen(skip);
+
+    if (send_full_message(sockfd, &msg, skip) < 0) {
+        perror("Erreur lors de l'envoi de la demande d'historique du salon");
+    }
+}
+
 // Fonction principale pour gérer la communication avec le serveur
 void echo_client(int sockfd) {
     handle_identification(sockfd);
@@ -300,7 +342,7 @@ void echo_client(int sockfd) {
                         msgstruct.type = NICKNAME_CHANGEMENT;
                         strncpy(msgstruct.infos, newNickname, INFOS_LEN - 1);
 
-                        send(sockfd, &msgstruct, sizeof(struct message), 0);
+                        send_full_message(sockfd, &msgstruct, NULL);
 
                         strncpy(pseudo, newNickname, NICK_LEN - 1);
                     } else {
@@ -320,7 +362,7 @@ void echo_client(int sockfd) {
                         msgstruct.type = NICKNAME_INFOS;
                         strncpy(msgstruct.infos, targetUser, INFOS_LEN - 1);
 
-                        send(sockfd, &msgstruct, sizeof(struct message), 0);
+                        send_full_message(sockfd, &msgstruct, NULL);
 
                         continue; 
                     } else {
@@ -338,7 +380,7 @@ void echo_client(int sockfd) {
 
                         strncpy(msgstruct.infos, broadcastMessage, INFOS_LEN - 1);
 
-                        send(sockfd, &msgstruct, sizeof(struct message), 0);
+                        send_full_message(sockfd, &msgstruct, NULL);
 
                     } else {
                         printf("Usage : /msgall <message>\n");
@@ -370,15 +412,33 @@ void echo_client(int sockfd) {
                     strncpy(msgstruct.nick_sender, pseudo, NICK_LEN - 1); 
                     msgstruct.infos[0] = '\0'; 
 
-                    if (send(sockfd, &msgstruct, sizeof(msgstruct), 0) < sizeof(msgstruct)) {
+                    if (send_full_message(sockfd, &msgstruct, NULL) < 0) {
                         perror("send()");
                     }
                     continue;
+                } else if (strncmp(buff, "/history ", 9) == 0) {
+                    // Un dernier mot fait de chiffres est le nombre de messages récents à sauter
+                    char* channel_name = buff + 9;
+                    char* skip = strrchr(channel_name, ' ');
+                    if (skip && skip > channel_name && skip[1] != '\0' && strspn(skip + 1, "0123456789") == strlen(skip + 1)) {
+                        *skip++ = '\0';
+                    } else {
+                        skip = "";
+                    }
+                    if (channel_name[0] != '\0') {
+                        send_multicast_history_message(sockfd, channel_name, skip);
+                    } else {
+                        printf("Usage : /history <nom_du_salon> [messages_à_sauter]\n");
+                    }
+                    continue;
                 } else if (strncmp(buff, "/quit ", 6) == 0) {
                     const char* channel_name = buff + 6; 
                     if (channel_name[0] != '\0') {
                         send_multicast_quit_message(sockfd, channel_name);
-                        current_channel[0] = '\0'; 
+                        // On reste membre des autres salons ; seul le salon courant est oublié
+                        if (strcmp(current_channel, channel_name) == 0) {
+                            current_channel[0] = '\0';
+                        }
                     } else {
                         printf("Usage : /quit <nom_du_salon>\n");
                     }
@@ -402,10 +462,8 @@ void echo_client(int sockfd) {
                         strncpy(msgstruct.nick_sender, pseudo, NICK_LEN - 1);
                         msgstruct.type = FILE_REQUEST;
                         strncpy(msgstruct.infos, target, NICK_LEN - 1);
-                        // Envoyer la structure du message
-                        send(sockfd, &msgstruct, sizeof(msgstruct), 0);
-                        // Envoyer le chemin du fichier
-                        send(sockfd, filePath, msgstruct.pld_len, 0);
+                        // Envoyer la structure du message et le chemin du fichier
+                        send_full_message(sockfd, &msgstruct, filePath);
                     } else {
                         printf("Usage : /send <destinataire> <chemin_du_fichier>\n");
                     }
@@ -418,10 +476,8 @@ void echo_client(int sockfd) {
                         strncpy(msgstruct.nick_sender, pseudo, NICK_LEN - 1);
                         msgstruct.type = MULTICAST_SEND;
                         strncpy(msgstruct.infos, current_channel, INFOS_LEN - 1); // Remplissez le champ infos avec le nom du salon
-                        // Envoyer la structure du message
-                        send(sockfd, &msgstruct, sizeof(msgstruct), 0);
-                        // Envoyer le contenu du message
-                        send(sockfd, buff, msgstruct.pld_len, 0);
+                        // Envoyer la structure du message et son contenu
+                        send_full_message(sockfd, &msgstruct, buff);
                     } else {
                         struct message msgstruct;
                         memset(&msgstruct, 0, sizeof(struct message));
@@ -429,10 +485,8 @@ void echo_client(int sockfd) {
                         strncpy(msgstruct.nick_sender, pseudo, NICK_LEN - 1);
                         msgstruct.type = ECHO_SEND;
 
-                        // Envoyer la structure du message
-                        send(sockfd, &msgstruct, sizeof(msgstruct), 0);
-                        // Envoyer le contenu du message
-                        send(sockfd, buff, msgstruct.pld_len, 0);
+                        // Envoyer la structure du message et son contenu
+                        send_full_message(sockfd, &msgstruct, buff);
                     }
                 }
             }
@@ -442,7 +496,7 @@ void echo_client(int sockfd) {
             memset(buff, 0, MSG_LEN);
             memset(&msgstruct, 0, sizeof(struct message));
 
-            if (recv(sockfd, &msgstruct, sizeof(struct message), 0) <= 0) {
+            if (receive_full_message(sockfd, &msgstruct, buff) <= 0) {
                 perror("Le serveur s'est déconnecté ou une erreur est survenue");
                 exit(EXIT_FAILURE);
             }
@@ -461,13 +515,7 @@ void echo_client(int sockfd) {
                 } else if (msgstruct.type == BROADCAST_SEND) {
                     printf("[%s] : %s\n", msgstruct.nick_sender, msgstruct.infos); 
                 } else if (msgstruct.type == UNICAST_SEND) {
-                    char private_message[INFOS_LEN];
-                    if (recv(sockfd, private_message, msgstruct.pld_len, 0) <= 0) {
-                        perror("Erreur lors de la réception du message privé");
-                        exit(EXIT_FAILURE);
-                    }
-                    private_message[msgstruct.pld_len] = '\0'; 
-                    printf("[%s] : %s\n", msgstruct.nick_sender, private_message);
+                    printf("[%s] : %s\n", msgstruct.nick_sender, buff);
                 } else if (msgstruct.type == MULTICAST_CREATE){
                     strncpy(current_channel, msgstruct.infos, INFOS_LEN - 1);
                     current_channel[INFOS_LEN - 1] = '\0';
@@ -488,21 +536,14 @@ void echo_client(int sockfd) {
                     if (strcmp(msgstruct.infos, "") != 0) {
                         printf("%s\n", msgstruct.infos); 
                     } 
+                } else if (msgstruct.type == MULTICAST_HISTORY) {
+                    printf("%s\n", msgstruct.infos);
                 } else if (msgstruct.type == MULTICAST_NOTIFICATION) {
                     printf("[%s] : %s\n", msgstruct.nick_sender, msgstruct.infos);
                 } else if (msgstruct.type == MULTICAST_SEND) {
-                    char multicast_message[INFOS_LEN];
-                    if (recv(sockfd, multicast_message, msgstruct.pld_len, 0) <= 0) {
-                        perror("Erreur lors de la réception du message multicast");
-                        exit(EXIT_FAILURE);
-                    }
-                    multicast_message[msgstruct.pld_len] = '\0'; 
-
-                    printf(" %s> : %s\n", msgstruct.nick_sender, multicast_message);
+                    printf("[%s] %s> : %s\n", msgstruct.infos, msgstruct.nick_sender, buff);
                 } else if (msgstruct.type == FILE_REQUEST) {
-                    char file_path[MSG_LEN];
-                    recv(sockfd, file_path, msgstruct.pld_len, 0);
-                    file_path[msgstruct.pld_len] = '\0';
+                    const char* file_path = buff;
 
                     printf("%s veut vous envoyer le fichier '%s'. Acceptez-vous? [Y/N]\n", msgstruct.nick_sender, file_path);
                     char response;
@@ -516,17 +557,20 @@ void echo_client(int sockfd) {
 
                     if (response == 'Y' || response == 'y') {
                         response_msg.type = FILE_ACCEPT;
-                        send(sockfd, &response_msg, sizeof(struct message), 0);
+                        send_full_message(sockfd, &response_msg, NULL);
                         printf("Transfert de fichier accepté. En attente du démarrage du transfert...\n");
                     } else {
                         response_msg.type = FILE_REJECT;
-                        send(sockfd, &response_msg, sizeof(struct message), 0);
+                        send_full_message(sockfd, &response_msg, NULL);
                         printf("Transfert de fichier refusé.\n");
                     } 
                 } else if (msgstruct.type == FILE_ACCEPT) {
                     printf("Votre demande de transfert de fichier vers %s a été acceptée.\n", msgstruct.nick_sender);
                 } else if (msgstruct.type == FILE_REJECT) {
                     printf("Votre demande de transfert de fichier vers %s a été refusée.\n", msgstruct.nick_sender);
+                    if (msgstruct.infos[0] != '\0') {
+                        printf("%s\n", msgstruct.infos);
+                    }
                 }
             }
         }
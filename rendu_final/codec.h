@@ -0,0 +1,119 @@
+//codec.h
+// Format compact (protocole version 2), négocié lors du NICKNAME_NEW :
+//   u16  longueur totale de la trame, en-tête compris (ordre réseau)
+//   u8   type (enum msg_type)
+//   u8   drapeaux : COMPACT_HAS_NICK, COMPACT_HAS_INFOS
+//   [u8  longueur + pseudo]   si COMPACT_HAS_NICK
+//   [u16 longueur + infos]    si COMPACT_HAS_INFOS (ordre réseau)
+//   charge utile : le reste de la trame
+// Les chaînes voyagent sans '\0' ; pld_len vaut la taille de la charge utile.
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PROTO_LEGACY 1
+#define PROTO_COMPACT 2
+// Valeur de infos dans le NICKNAME_NEW d'un client qui demande le format compact ;
+// le serveur accepte en renvoyant un NICKNAME_NEW (format historique) avec pld_len = PROTO_COMPACT
+#define PROTO_COMPACT_HELLO "proto=2"
+
+#define COMPACT_HEADER_LEN 4
+#define COMPACT_HAS_NICK 0x01
+#define COMPACT_HAS_INFOS 0x02
+#define COMPACT_MAX_PAYLOAD 1023
+#define COMPACT_MAX_FRAME (COMPACT_HEADER_LEN + 1 + (NICK_LEN - 1) + 2 + (INFOS_LEN - 1) + COMPACT_MAX_PAYLOAD)
+
+// Fonction pour encoder un message au format compact dans out (COMPACT_MAX_FRAME octets)
+// Retourne la longueur de la trame, ou 0 si la charge utile est trop grande
+static size_t compact_encode(const struct message* msg, const char* payload, size_t payload_len, char* out) {
+    size_t nick_len = strnlen(msg->nick_sender, NICK_LEN - 1);
+    size_t infos_len = strnlen(msg->infos, INFOS_LEN - 1);
+    size_t pos = COMPACT_HEADER_LEN;
+    uint8_t flags = 0;
+
+    if (payload_len > COMPACT_MAX_PAYLOAD) {
+        return 0;
+    }
+    if (nick_len > 0) {
+        flags |= COMPACT_HAS_NICK;
+        out[pos++] = (char)nick_len;
+        memcpy(out + pos, msg->nick_sender, nick_len);
+        pos += nick_len;
+    }
+    if (infos_len > 0) {
+        uint16_t len16 = htons((uint16_t)infos_len);
+        flags |= COMPACT_HAS_INFOS;
+        memcpy(out + pos, &len16, 2);
+        pos += 2;
+        memcpy(out + pos, msg->infos, infos_len);
+        pos += infos_len;
+    }
+    if (payload_len > 0) {
+        memcpy(out + pos, payload, payload_len);
+        pos += payload_len;
+    }
+
+    uint16_t total = htons((uint16_t)pos);
+    memcpy(out, &total, 2);
+    out[2] = (char)msg->type;
+    out[3] = (char)flags;
+    return pos;
+}
+
+// Fonction pour lire la longueur totale annoncée par les deux premiers octets d'une trame compacte
+static size_t compact_frame_len(const char* frame) {
+    uint16_t total;
+    memcpy(&total, frame, 2);
+    return ntohs(total);
+}
+
+// Fonction pour décoder une trame compacte complète de len octets
+// payload doit pouvoir contenir COMPACT_MAX_PAYLOAD + 1 octets ; il est terminé par '\0'
+// Retourne la taille de la charge utile, ou -1 si la trame est mal formée
+static int compact_decode(const char* frame, size_t len, struct message* msg, char* payload) {
+    size_t pos = COMPACT_HEADER_LEN;
+    uint8_t flags;
+
+    if (len < COMPACT_HEADER_LEN || len > COMPACT_MAX_FRAME || compact_frame_len(frame) != len) {
+        return -1;
+    }
+    memset(msg, 0, sizeof(struct message));
+    msg->type = (enum msg_type)(uint8_t)frame[2];
+    flags = (uint8_t)frame[3];
+
+    if (flags & COMPACT_HAS_NICK) {
+        size_t nick_len;
+        if (pos + 1 > len) {
+            return -1;
+        }
+        nick_len = (uint8_t)frame[pos++];
+        if (nick_len > NICK_LEN - 1 || pos + nick_len > len) {
+            return -1;
+        }
+        memcpy(msg->nick_sender, frame + pos, nick_len);
+        pos += nick_len;
+    }
+    if (flags & COMPACT_HAS_INFOS) {
+        uint16_t len16;
+        size_t infos_len;
+        if (pos + 2 > len) {
+            return -1;
+        }
+        memcpy(&len16, frame + pos, 2);
+        pos += 2;
+        infos_len = ntohs(len16);
+        if (infos_len > INFOS_LEN - 1 || pos + infos_len > len) {
+            return -1;
+        }
+        memcpy(msg->infos, frame + pos, infos_len);
+        pos += infos_len;
+    }
+
+    msg->pld_len = (int)(len - pos);
+    if (msg->pld_len > COMPACT_MAX_PAYLOAD) {
+        return -1;
+    }
+    memcpy(payload, frame + pos, msg->pld_len);
+    payload[msg->pld_len] = '\0';
+    return msg->pld_len;
+}
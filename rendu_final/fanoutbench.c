@@ -0,0 +1,674 @@
+//fanoutbench.c
+// Mesure de la diffusion (BROADCAST_SEND et MULTICAST_SEND) quand le nombre de destinataires augmente
+// Pour chaque configuration (mode, destinataires, salons, taille du texte), un serveur neuf est lancé,
+// les sessions s'y connectent, puis un émetteur par groupe envoie en continu avec au plus --window
+// messages non encore reçus par tous ses destinataires. Une ligne CSV est écrite par configuration :
+// messages/s, livraisons/s, octets/s, temps CPU du serveur par livraison (lu dans /proc) et latences.
+//   broadcast : un émetteur, R destinataires (toutes les autres sessions)
+//   multicast : C salons, chacun avec un émetteur et R destinataires
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "msg_struct.h"
+#include "bench.h"
+
+#define CHANNEL_LEN 32
+#define MSG_LEN 1024
+#define RX_CAP (16 * 1024)
+#define MAX_THREADS 64
+#define MAX_SWEEP 16
+#define WARMUP_MS 500
+#define STALL_MS 1000
+#define SETUP_TIMEOUT_MS 120000
+
+enum bench_mode {
+    MODE_BROADCAST,
+    MODE_MULTICAST,
+};
+
+typedef struct Session {
+    int fd;
+    int group;              // groupe dont la session est l'émettrice, -1 pour un destinataire
+    size_t rx_len;
+    char rx[RX_CAP];
+} Session;
+
+// Un émetteur et ses destinataires
+typedef struct Group {
+    int sender;
+    int recipients;
+    unsigned long sent;
+    unsigned long long lost;        // livraisons abandonnées après un blocage de la fenêtre
+    long long last_progress_ns;
+    unsigned long long seen;
+    _Atomic unsigned long long delivered;
+} Group;
+
+typedef struct Receiver {
+    pthread_t thread;
+    int first;
+    int count;
+    int epfd;
+    unsigned long deliveries;
+    unsigned long long bytes;
+    unsigned long hist[HIST_BUCKETS];
+} Receiver;
+
+// Une configuration de la série
+typedef struct Config {
+    enum bench_mode mode;
+    int recipients;
+    int channels;
+    int payload;
+} Config;
+
+// Paramètres de la série
+static const char* server_path = "./server";
+static char* server_args[32];
+static int server_argc;
+static int base_port = 41000;
+static int recipients_sweep[MAX_SWEEP] = {10, 100, 1000, 10000};
+static int recipients_sweep_len = 4;
+static int sizes_sweep[MAX_SWEEP] = {32, 256, 1000};
+static int sizes_sweep_len = 3;
+static int channels_sweep[MAX_SWEEP] = {1, 4};
+static int channels_sweep_len = 2;
+static bool run_broadcast = true;
+static bool run_multicast = true;
+static int duration_s = 3;
+static int window = 4;
+static int thread_count = 4;
+static int max_sessions = 20000;
+// Chaque arrivée dans un salon est annoncée à tous ses membres : la mise en place d'un salon
+// de R membres coûte R²/2 annonces, d'où une limite à part pour le mode multicast
+static int max_members = 2000;
+
+// État de la configuration en cours
+static Session* sessions;
+static int session_count;
+static Group* groups;
+static int group_count;
+static Receiver receivers[MAX_THREADS];
+static int receiver_count;
+static enum bench_mode current_mode;
+static int payload_size;
+static char port_str[16];
+static pid_t server_pid;
+// Bornes de la mesure, déplacées une fois les threads de réception lancés
+static _Atomic long long measure_start_ns;
+static _Atomic long long measure_end_ns;
+static long long cpu_samples[2];
+static _Atomic bool stopping;
+static _Atomic unsigned long join_acks;
+static _Atomic unsigned long closed_sessions;
+static _Atomic unsigned long long setup_bytes;
+
+// Fonction pour attendre ms millisecondes
+static void sleep_ms(long ms) {
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+// Fonction pour lire le temps CPU (utilisateur + système) consommé par un processus, en nanosecondes
+static long long process_cpu_ns(pid_t pid) {
+    char path[64];
+    char buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    // Le nom du programme peut contenir des espaces : on repart de la dernière parenthèse
+    char* p = strrchr(buf, ')');
+    if (!p) {
+        return -1;
+    }
+    unsigned long utime = 0, stime = 0;
+    // Après ")" : état (3), puis les champs 4 à 13, utime (14) et stime (15)
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+        return -1;
+    }
+    return (long long)(utime + stime) * (1000000000LL / sysconf(_SC_CLK_TCK));
+}
+
+// Fonction pour lancer un serveur neuf, sortie standard vers /dev/null ; -1 s'il ne répond pas
+static int start_server(int port) {
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    char* argv[40];
+    int argc = 0;
+    argv[argc++] = (char*)server_path;
+    for (int i = 0; i < server_argc; i++) {
+        argv[argc++] = server_args[i];
+    }
+    argv[argc++] = port_str;
+    argv[argc] = NULL;
+
+    server_pid = fork();
+    if (server_pid == -1) {
+        perror("fork()");
+        exit(EXIT_FAILURE);
+    }
+    if (server_pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+        execv(server_path, argv);
+        _exit(127);
+    }
+
+    // Le serveur est prêt dès qu'il accepte une connexion
+    for (int attempt = 0; attempt < 100; attempt++) {
+        if (waitpid(server_pid, NULL, WNOHANG) == server_pid) {
+            return -1;
+        }
+        int fd = bench_connect("127.0.0.1", port_str);
+        if (fd != -1) {
+            close(fd);
+            return 0;
+        }
+        sleep_ms(20);
+    }
+    kill(server_pid, SIGKILL);
+    waitpid(server_pid, NULL, 0);
+    return -1;
+}
+
+// Fonction exécutée par le thread qui relève le temps CPU du serveur au début et à la fin de la mesure
+static void* cpu_sampler_thread(void* arg) {
+    (void)arg;
+    long long bounds[2] = {measure_start_ns, measure_end_ns};
+    for (int i = 0; i < 2; i++) {
+        long long wait = bounds[i] - now_ns();
+        if (wait > 0) {
+            struct timespec ts = {.tv_sec = wait / 1000000000LL, .tv_nsec = wait % 1000000000LL};
+            nanosleep(&ts, NULL);
+        }
+        cpu_samples[i] = process_cpu_ns(server_pid);
+    }
+    return NULL;
+}
+
+// Fonction pour arrêter le serveur de la configuration en cours
+static void stop_server() {
+    kill(server_pid, SIGKILL);
+    waitpid(server_pid, NULL, 0);
+}
+
+// Fonction pour remplir le texte d'un message : "<groupe> <instant>" puis du bourrage
+static int fill_text(char* out, size_t cap, int group, long long sent_ns) {
+    int len = snprintf(out, cap, "%d %lld ", group, sent_ns);
+    int target = payload_size < (int)cap - 1 ? payload_size : (int)cap - 1;
+    while (len < target) {
+        out[len++] = 'x';
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Fonction pour traiter une livraison : latence et avancement de la fenêtre de l'émetteur
+static void handle_delivery(Receiver* receiver, const char* text, long long now) {
+    char* end;
+    long group = strtol(text, &end, 10);
+    if (end == text || *end != ' ' || group < 0 || group >= group_count) {
+        return;
+    }
+    long long sent_ns = strtoll(end + 1, &end, 10);
+    atomic_fetch_add_explicit(&groups[group].delivered, 1, memory_order_relaxed);
+    if (sent_ns >= measure_start_ns && now < measure_end_ns && now >= sent_ns) {
+        receiver->deliveries++;
+        receiver->hist[hist_bucket(now - sent_ns)]++;
+    }
+}
+
+// Fonction pour traiter une trame reçue par une session
+static void handle_frame(Receiver* receiver, Session* session, struct message* msg, char* payload, long long now) {
+    if (msg->type == BROADCAST_SEND) {
+        handle_delivery(receiver, msg->infos, now);
+    } else if (msg->type == MULTICAST_SEND) {
+        handle_delivery(receiver, payload, now);
+    } else if (msg->type == MULTICAST_JOIN) {
+        atomic_fetch_add(&join_acks, 1);
+    } else if (msg->type == PING && session->group == -1) {
+        // Les émetteurs sont actifs et ne reçoivent pas de PING ; leur socket n'est écrite que par l'émetteur
+        struct message pong_msg;
+        memset(&pong_msg, 0, sizeof(pong_msg));
+        pong_msg.type = PONG;
+        write_all(session->fd, &pong_msg, sizeof(pong_msg));
+    }
+}
+
+// Fonction pour lire tout ce qui est disponible sur une session et traiter les trames complètes
+static void session_readable(Receiver* receiver, Session* session) {
+    while (session->fd != -1) {
+        ssize_t ret = recv(session->fd, session->rx + session->rx_len, RX_CAP - session->rx_len, MSG_DONTWAIT);
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (ret <= 0) {
+            epoll_ctl(receiver->epfd, EPOLL_CTL_DEL, session->fd, NULL);
+            session->fd = -1;
+            atomic_fetch_add(&closed_sessions, 1);
+            return;
+        }
+        session->rx_len += ret;
+        long long now = now_ns();
+        if (now >= measure_start_ns && now < measure_end_ns) {
+            receiver->bytes += ret;
+        } else {
+            atomic_fetch_add_explicit(&setup_bytes, ret, memory_order_relaxed);
+        }
+
+        size_t pos = 0;
+        while (session->rx_len - pos >= sizeof(struct message)) {
+            struct message msg;
+            char payload[MSG_LEN];
+            memcpy(&msg, session->rx + pos, sizeof(msg));
+            msg.infos[INFOS_LEN - 1] = '\0';
+            size_t frame_len = sizeof(struct message);
+            payload[0] = '\0';
+            if ((msg.type == UNICAST_SEND || msg.type == MULTICAST_SEND || msg.type == FILE_REQUEST) && msg.pld_len > 0) {
+                if (msg.pld_len >= MSG_LEN) {
+                    fprintf(stderr, "Trame invalide reçue du serveur\n");
+                    exit(EXIT_FAILURE);
+                }
+                if (session->rx_len - pos < frame_len + msg.pld_len) {
+                    break;
+                }
+                memcpy(payload, session->rx + pos + frame_len, msg.pld_len);
+                payload[msg.pld_len] = '\0';
+                frame_len += msg.pld_len;
+            }
+            pos += frame_len;
+            handle_frame(receiver, session, &msg, payload, now);
+        }
+        memmove(session->rx, session->rx + pos, session->rx_len - pos);
+        session->rx_len -= pos;
+    }
+}
+
+// Fonction exécutée par chaque thread de réception
+static void* receiver_thread(void* arg) {
+    Receiver* receiver = arg;
+    struct epoll_event events[256];
+    while (!atomic_load(&stopping)) {
+        int n = epoll_wait(receiver->epfd, events, 256, 10);
+        for (int i = 0; i < n; i++) {
+            session_readable(receiver, events[i].data.ptr);
+        }
+    }
+    return NULL;
+}
+
+// Fonction pour envoyer le message suivant d'un groupe
+static int send_next(Group* group, long long now) {
+    Session* sender = &sessions[group->sender];
+    struct message msg;
+    char text[MSG_LEN];
+    memset(&msg, 0, sizeof(msg));
+    snprintf(msg.nick_sender, NICK_LEN, "f%d", group->sender);
+
+    if (current_mode == MODE_BROADCAST) {
+        msg.type = BROADCAST_SEND;
+        fill_text(msg.infos, INFOS_LEN, (int)(group - groups), now);
+        return write_all(sender->fd, &msg, sizeof(msg));
+    }
+    msg.type = MULTICAST_SEND;
+    snprintf(msg.infos, CHANNEL_LEN, "f%d", (int)(group - groups));
+    msg.pld_len = fill_text(text, sizeof(text), (int)(group - groups), now);
+    if (write_all(sender->fd, &msg, sizeof(msg)) == -1) {
+        return -1;
+    }
+    return write_all(sender->fd, text, msg.pld_len);
+}
+
+// Fonction pour faire émettre les groupes jusqu'à la fin de la mesure, fenêtre par fenêtre
+// Retourne le nombre de messages émis pendant la mesure
+static unsigned long run_senders() {
+    unsigned long measured = 0;
+    for (int g = 0; g < group_count; g++) {
+        groups[g].last_progress_ns = now_ns();
+    }
+    for (long long now = now_ns(); now < measure_end_ns; now = now_ns()) {
+        bool sent_any = false;
+        for (int g = 0; g < group_count; g++) {
+            Group* group = &groups[g];
+            if (sessions[group->sender].fd == -1) {
+                continue;
+            }
+            unsigned long long delivered = atomic_load_explicit(&group->delivered, memory_order_relaxed);
+            if (delivered != group->seen) {
+                group->seen = delivered;
+                group->last_progress_ns = now;
+            }
+            unsigned long long expected = (unsigned long long)group->sent * group->recipients - group->lost;
+            if (expected - delivered >= (unsigned long long)window * group->recipients) {
+                if (now - group->last_progress_ns < STALL_MS * 1000000LL) {
+                    continue;
+                }
+                // Livraisons perdues (destinataire déconnecté) : on les abandonne pour débloquer la fenêtre
+                group->lost += expected - delivered;
+                group->last_progress_ns = now;
+            }
+            if (send_next(group, now) == -1) {
+                sessions[group->sender].fd = -1;
+                continue;
+            }
+            group->sent++;
+            sent_any = true;
+            if (now >= measure_start_ns) {
+                measured++;
+            }
+        }
+        if (!sent_any) {
+            sched_yield();
+        }
+    }
+    return measured;
+}
+
+// Fonction pour ouvrir les sessions d'une configuration : émetteurs d'abord, puis destinataires
+static int open_sessions(const Config* config) {
+    group_count = config->mode == MODE_BROADCAST ? 1 : config->channels;
+    session_count = group_count * (config->recipients + 1);
+    sessions = calloc(session_count, sizeof(Session));
+    groups = calloc(group_count, sizeof(Group));
+    if (!sessions || !groups) {
+        perror("Échec d'allocation mémoire pour les sessions");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < session_count; i++) {
+        char nickname[NICK_LEN];
+        snprintf(nickname, sizeof(nickname), "f%d", i);
+        sessions[i].group = i < group_count ? i : -1;
+        sessions[i].fd = bench_open_session("127.0.0.1", port_str, nickname);
+        if (sessions[i].fd == -1) {
+            fprintf(stderr, "Échec de l'ouverture de la session %d\n", i);
+            return -1;
+        }
+    }
+    for (int g = 0; g < group_count; g++) {
+        groups[g].sender = g;
+        groups[g].recipients = config->recipients;
+        if (config->mode == MODE_MULTICAST) {
+            struct message msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.type = MULTICAST_CREATE;
+            snprintf(msg.infos, CHANNEL_LEN, "f%d", g);
+            if (write_all(sessions[g].fd, &msg, sizeof(msg)) == -1 || read_reply(sessions[g].fd, &msg) == -1 || msg.type != MULTICAST_CREATE) {
+                fprintf(stderr, "Impossible de créer le salon f%d\n", g);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Fonction pour faire rejoindre leur salon aux destinataires, puis attendre que le trafic d'annonces
+// (un MULTICAST_NOTIFICATION par membre et par arrivée) soit écoulé
+static int join_channels() {
+    for (int i = group_count; i < session_count; i++) {
+        struct message msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.type = MULTICAST_JOIN;
+        snprintf(msg.infos, CHANNEL_LEN, "f%d", (i - group_count) % group_count);
+        if (write_all(sessions[i].fd, &msg, sizeof(msg)) == -1) {
+            return -1;
+        }
+    }
+    long long deadline = now_ns() + SETUP_TIMEOUT_MS * 1000000LL;
+    unsigned long expected = session_count - group_count;
+    while (atomic_load(&join_acks) < expected) {
+        if (now_ns() > deadline) {
+            fprintf(stderr, "Seulement %lu arrivées acquittées sur %lu\n", atomic_load(&join_acks), expected);
+            return -1;
+        }
+        sleep_ms(10);
+    }
+    unsigned long long before;
+    do {
+        before = atomic_load(&setup_bytes);
+        sleep_ms(100);
+    } while (atomic_load(&setup_bytes) != before);
+    return 0;
+}
+
+// Fonction pour exécuter une configuration et écrire sa ligne CSV
+static void run_config(const Config* config, int port) {
+    current_mode = config->mode;
+    payload_size = config->payload;
+    atomic_store(&stopping, false);
+    atomic_store(&join_acks, 0);
+    atomic_store(&closed_sessions, 0);
+    atomic_store(&setup_bytes, 0);
+    memset(receivers, 0, sizeof(receivers));
+    // Rien n'est mesuré pendant la mise en place
+    measure_start_ns = measure_end_ns = now_ns() + 3600 * 1000000000LL;
+
+    // Le port peut être pris par un autre programme : on en essaie quelques autres plus loin
+    int attempt = 0;
+    while (start_server(port + attempt * 1000) == -1) {
+        if (++attempt == 5) {
+            fprintf(stderr, "Le serveur %s n'a pas démarré (ports %d à %d)\n", server_path, port, port + 4000);
+            return;
+        }
+    }
+    if (open_sessions(config) == -1) {
+        stop_server();
+        exit(EXIT_FAILURE);
+    }
+
+    receiver_count = thread_count < session_count ? thread_count : session_count;
+    for (int t = 0; t < receiver_count; t++) {
+        Receiver* receiver = &receivers[t];
+        receiver->first = (int)((long long)session_count * t / receiver_count);
+        receiver->count = (int)((long long)session_count * (t + 1) / receiver_count) - receiver->first;
+        receiver->epfd = epoll_create1(0);
+        for (int i = 0; i < receiver->count; i++) {
+            Session* session = &sessions[receiver->first + i];
+            struct epoll_event ev = {.events = EPOLLIN, .data.ptr = session};
+            epoll_ctl(receiver->epfd, EPOLL_CTL_ADD, session->fd, &ev);
+        }
+        pthread_create(&receiver->thread, NULL, receiver_thread, receiver);
+    }
+
+    bool ready = config->mode == MODE_BROADCAST || join_channels() == 0;
+    unsigned long messages = 0;
+    long long cpu_start = 0, cpu_end = 0;
+    if (ready) {
+        measure_start_ns = now_ns() + WARMUP_MS * 1000000LL;
+        measure_end_ns = measure_start_ns + duration_s * 1000000000LL;
+        // Le temps CPU du serveur est relevé par un thread à part, aux bornes exactes de la mesure
+        pthread_t sampler;
+        pthread_create(&sampler, NULL, cpu_sampler_thread, NULL);
+        messages = run_senders();
+        pthread_join(sampler, NULL);
+        cpu_start = cpu_samples[0];
+        cpu_end = cpu_samples[1];
+    }
+
+    // Laisse arriver les dernières livraisons de la fenêtre avant d'arrêter la réception
+    sleep_ms(200);
+    atomic_store(&stopping, true);
+    unsigned long deliveries = 0;
+    unsigned long long bytes = 0;
+    unsigned long hist[HIST_BUCKETS] = {0};
+    for (int t = 0; t < receiver_count; t++) {
+        pthread_join(receivers[t].thread, NULL);
+        close(receivers[t].epfd);
+        deliveries += receivers[t].deliveries;
+        bytes += receivers[t].bytes;
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            hist[b] += receivers[t].hist[b];
+        }
+    }
+    stop_server();
+    for (int i = 0; i < session_count; i++) {
+        if (sessions[i].fd != -1) {
+            close(sessions[i].fd);
+        }
+    }
+    free(sessions);
+    free(groups);
+
+    if (!ready) {
+        fprintf(stderr, "Configuration abandonnée : mise en place incomplète\n");
+        return;
+    }
+    double seconds = duration_s;
+    double cpu_per_delivery = deliveries > 0 && cpu_start >= 0 && cpu_end >= 0 ? (double)(cpu_end - cpu_start) / deliveries : 0;
+    printf("%s,%d,%d,%d,%d,%lu,%lu,%.0f,%.0f,%.0f,%.0f,%.1f,%.1f,%.1f,%.1f,%lu\n",
+           config->mode == MODE_BROADCAST ? "broadcast" : "multicast", config->recipients, group_count,
+           config->mode == MODE_BROADCAST && config->payload > INFOS_LEN - 1 ? INFOS_LEN - 1 : config->payload,
+           session_count, messages, deliveries, messages / seconds, deliveries / seconds, bytes / seconds,
+           cpu_per_delivery, hist_quantile(hist, 0.50) / 1e3, hist_quantile(hist, 0.99) / 1e3,
+           hist_quantile(hist, 0.999) / 1e3, hist_quantile(hist, 1.0) / 1e3, atomic_load(&closed_sessions));
+    fflush(stdout);
+}
+
+// Fonction pour lire une liste d'entiers positifs séparés par des virgules
+static bool parse_list(const char* arg, int* values, int* count) {
+    int n = 0;
+    const char* p = arg;
+    while (*p) {
+        char* end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value <= 0 || n == MAX_SWEEP) {
+            return false;
+        }
+        values[n++] = (int)value;
+        p = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return false;
+        }
+    }
+    *count = n;
+    return n > 0;
+}
+
+// Fonction pour découper les arguments à transmettre au serveur (séparés par des espaces)
+static bool parse_server_args(char* arg) {
+    server_argc = 0;
+    for (char* token = strtok(arg, " "); token; token = strtok(NULL, " ")) {
+        if (server_argc == (int)(sizeof(server_args) / sizeof(server_args[0]))) {
+            return false;
+        }
+        server_args[server_argc++] = token;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    static const struct option long_options[] = {
+        {"server", required_argument, NULL, 'S'},
+        {"server-args", required_argument, NULL, 'a'},
+        {"port", required_argument, NULL, 'p'},
+        {"modes", required_argument, NULL, 'M'},
+        {"recipients", required_argument, NULL, 'R'},
+        {"sizes", required_argument, NULL, 's'},
+        {"channels", required_argument, NULL, 'c'},
+        {"duration", required_argument, NULL, 'd'},
+        {"window", required_argument, NULL, 'w'},
+        {"threads", required_argument, NULL, 't'},
+        {"max-sessions", required_argument, NULL, 'm'},
+        {"max-members", required_argument, NULL, 'x'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    bool bad = false;
+    while ((opt = getopt_long(argc, argv, "S:a:p:M:R:s:c:d:w:t:m:x:", long_options, NULL)) != -1) {
+        if (opt == 'S') {
+            server_path = optarg;
+        } else if (opt == 'a' && parse_server_args(optarg)) {
+            // arguments déjà découpés
+        } else if (opt == 'p' && atoi(optarg) > 0 && atoi(optarg) < 65536) {
+            base_port = atoi(optarg);
+        } else if (opt == 'M') {
+            run_broadcast = strstr(optarg, "broadcast") != NULL;
+            run_multicast = strstr(optarg, "multicast") != NULL;
+            bad = bad || (!run_broadcast && !run_multicast);
+        } else if ((opt == 'R' && parse_list(optarg, recipients_sweep, &recipients_sweep_len)) ||
+                   (opt == 's' && parse_list(optarg, sizes_sweep, &sizes_sweep_len)) ||
+                   (opt == 'c' && parse_list(optarg, channels_sweep, &channels_sweep_len))) {
+            // série déjà lue
+        } else if (opt == 'd' && atoi(optarg) > 0) {
+            duration_s = atoi(optarg);
+        } else if (opt == 'w' && atoi(optarg) > 0) {
+            window = atoi(optarg);
+        } else if (opt == 't' && atoi(optarg) > 0 && atoi(optarg) <= MAX_THREADS) {
+            thread_count = atoi(optarg);
+        } else if (opt == 'm' && atoi(optarg) > 1) {
+            max_sessions = atoi(optarg);
+        } else if (opt == 'x' && atoi(optarg) > 0) {
+            max_members = atoi(optarg);
+        } else {
+            bad = true;
+        }
+    }
+    if (bad || optind != argc) {
+        fprintf(stderr, "Utilisation : %s [--server ./server] [--server-args \"-t 4\"] [--port base] [--modes broadcast,multicast] "
+                        "[--recipients 10,100,1000,10000] [--sizes 32,256,1000] [--channels 1,4] [--duration s] [--window N] "
+                        "[--threads N] [--max-sessions N] [--max-members N]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+
+    Config configs[2 * MAX_SWEEP * MAX_SWEEP * MAX_SWEEP];
+    int config_count = 0;
+    for (int r = 0; r < recipients_sweep_len; r++) {
+        for (int s = 0; s < sizes_sweep_len; s++) {
+            if (run_broadcast) {
+                configs[config_count++] = (Config){MODE_BROADCAST, recipients_sweep[r], 1, sizes_sweep[s]};
+            }
+            for (int c = 0; run_multicast && c < channels_sweep_len; c++) {
+                configs[config_count++] = (Config){MODE_MULTICAST, recipients_sweep[r], channels_sweep[c], sizes_sweep[s]};
+            }
+        }
+    }
+
+    printf("mode,recipients,channels,payload,sessions,messages,deliveries,msgs_per_s,deliveries_per_s,bytes_per_s,"
+           "server_cpu_ns_per_delivery,p50_us,p99_us,p999_us,max_us,closed\n");
+    fflush(stdout);
+    for (int i = 0; i < config_count; i++) {
+        Config* config = &configs[i];
+        int sessions_needed = (config->mode == MODE_BROADCAST ? 1 : config->channels) * (config->recipients + 1);
+        if (sessions_needed > max_sessions) {
+            fprintf(stderr, "# %s %d destinataires x %d salons : %d sessions, au-delà de --max-sessions, ignorée\n",
+                    config->mode == MODE_BROADCAST ? "broadcast" : "multicast", config->recipients, config->channels, sessions_needed);
+            continue;
+        }
+        if (config->mode == MODE_MULTICAST && config->recipients > max_members) {
+            fprintf(stderr, "# multicast %d destinataires : au-delà de --max-members (annonces d'arrivée en R²), ignorée\n",
+                    config->recipients);
+            continue;
+        }
+        fprintf(stderr, "# %s %d destinataires, %d salon(s), %d octets\n",
+                config->mode == MODE_BROADCAST ? "broadcast" : "multicast", config->recipients,
+                config->mode == MODE_BROADCAST ? 1 : config->channels, config->payload);
+        // Un port par configuration : celui de la précédente peut encore être en TIME_WAIT
+        run_config(config, base_port + i);
+    }
+    exit(EXIT_SUCCESS);
+}
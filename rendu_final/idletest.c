@@ -0,0 +1,188 @@
+//idletest.c
+// Vérification du keepalive : un serveur neuf est lancé avec --keepalive 1 --idle-timeout 2, puis
+//   historique : un client au format historique, qui ne répond jamais aux PING, reste silencieux
+//                au-delà de --idle-timeout ; il doit être encore connecté (son /who reçoit une réponse)
+//   compact    : un client qui a annoncé le format compact reçoit des PING, n'y répond pas
+//                et doit être déconnecté pour inactivité
+// Le code de sortie vaut 0 si les deux vérifications passent (make check).
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "common.h"
+#include "msg_struct.h"
+#include "codec.h"
+#include "wire.h"
+
+#define IDLE_KEEPALIVE_S 1
+#define IDLE_TIMEOUT_S 2
+#define MSG_LEN 1024
+
+static pid_t server_pid;
+
+// Fonction pour ouvrir une connexion vers le serveur local ; -1 en cas d'échec
+static int connect_local(const char* port) {
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo("127.0.0.1", port, &hints, &result) != 0) {
+        return -1;
+    }
+    int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (fd != -1 && connect(fd, result->ai_addr, result->ai_addrlen) == -1) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+// Fonction pour lancer le serveur sur port ; -1 s'il n'accepte pas de connexion à temps
+static int start_server(const char* server_path, const char* port) {
+    server_pid = fork();
+    if (server_pid == -1) {
+        perror("fork()");
+        exit(EXIT_FAILURE);
+    }
+    if (server_pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+        char keepalive[16], timeout[16];
+        snprintf(keepalive, sizeof(keepalive), "%d", IDLE_KEEPALIVE_S);
+        snprintf(timeout, sizeof(timeout), "%d", IDLE_TIMEOUT_S);
+        execl(server_path, server_path, "--keepalive", keepalive, "--idle-timeout", timeout, port, (char*)NULL);
+        _exit(127);
+    }
+
+    // Le serveur est prêt dès qu'il accepte une connexion
+    for (int attempt = 0; attempt < 100; attempt++) {
+        if (waitpid(server_pid, NULL, WNOHANG) == server_pid) {
+            return -1;
+        }
+        int fd = connect_local(port);
+        if (fd != -1) {
+            close(fd);
+            return 0;
+        }
+        usleep(20000);
+    }
+    return -1;
+}
+
+// Fonction pour savoir si une trame du serveur est suivie d'une charge utile (format historique)
+static bool server_frame_has_payload(enum msg_type type) {
+    return type == UNICAST_SEND || type == MULTICAST_SEND || type == FILE_REQUEST;
+}
+
+// Fonction pour envoyer le NICKNAME_NEW d'un client ; hello vaut PROTO_COMPACT_HELLO ou ""
+// Retourne le format accepté par le serveur, ou -1
+static int identify(int fd, const char* nickname, const char* hello) {
+    struct message msg;
+    char payload[MSG_LEN];
+    memset(&msg, 0, sizeof(msg));
+    msg.type = NICKNAME_NEW;
+    strncpy(msg.nick_sender, nickname, NICK_LEN - 1);
+    strncpy(msg.infos, hello, INFOS_LEN - 1);
+    // L'acquittement arrive au format historique, sans charge utile : pld_len porte le format retenu
+    if (send_legacy_message(fd, &msg, NULL) == -1 || receive_legacy_message(fd, &msg, payload, sizeof(payload), server_frame_has_payload) == -1 ||
+        msg.type != NICKNAME_NEW) {
+        return -1;
+    }
+    return msg.pld_len;
+}
+
+// Fonction pour vérifier qu'un client historique silencieux survit à --idle-timeout
+static bool check_legacy_client(const char* port) {
+    int fd = connect_local(port);
+    if (fd == -1 || identify(fd, "historique", "") != PROTO_LEGACY) {
+        fprintf(stderr, "historique : identification impossible\n");
+        return false;
+    }
+    sleep(IDLE_TIMEOUT_S + 2);
+
+    struct message msg;
+    char payload[MSG_LEN];
+    memset(&msg, 0, sizeof(msg));
+    msg.type = NICKNAME_LIST;
+    bool alive = send_legacy_message(fd, &msg, NULL) != -1;
+    // Un serveur qui enverrait des PING au client historique les verrait ignorés, comme le fait ce client
+    do {
+        alive = alive && receive_legacy_message(fd, &msg, payload, sizeof(payload), server_frame_has_payload) != -1;
+    } while (alive && msg.type == PING);
+    close(fd);
+    if (!alive || msg.type != NICKNAME_LIST) {
+        fprintf(stderr, "historique : déconnecté après %d s de silence\n", IDLE_TIMEOUT_S + 2);
+        return false;
+    }
+    return true;
+}
+
+// Fonction pour vérifier qu'un client compact qui ne répond pas aux PING est déconnecté
+static bool check_compact_client(const char* port) {
+    int fd = connect_local(port);
+    if (fd == -1 || identify(fd, "compact", PROTO_COMPACT_HELLO) != PROTO_COMPACT) {
+        fprintf(stderr, "compact : format compact refusé\n");
+        return false;
+    }
+
+    // Une requête au format compact, puis plus rien : les trames reçues sont décodées
+    // jusqu'à la fermeture par le serveur, et aucune n'obtient de PONG
+    char frame[COMPACT_MAX_FRAME];
+    char payload[COMPACT_MAX_PAYLOAD + 1];
+    struct message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = NICKNAME_LIST;
+    struct iovec iov = {.iov_base = frame, .iov_len = compact_encode(&msg, NULL, 0, frame)};
+    if (writev_all(fd, &iov, 1) == -1) {
+        close(fd);
+        return false;
+    }
+    struct timeval timeout = {.tv_sec = IDLE_TIMEOUT_S + 3, .tv_usec = 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int pings = 0;
+    errno = 0;
+    while (read_all(fd, frame, 2) != -1) {
+        size_t len = compact_frame_len(frame);
+        if (len < COMPACT_HEADER_LEN || len > COMPACT_MAX_FRAME || read_all(fd, frame + 2, len - 2) == -1 ||
+            compact_decode(frame, len, &msg, payload) < 0) {
+            break;
+        }
+        pings += msg.type == PING;
+    }
+    // read_all() échoue aussi bien sur une fermeture que sur l'expiration de SO_RCVTIMEO
+    bool closed = errno != EAGAIN && errno != EWOULDBLOCK;
+    close(fd);
+    if (pings == 0 || !closed) {
+        fprintf(stderr, "compact : %d PING reçus, %s\n", pings, closed ? "déconnecté" : "toujours connecté sans PONG");
+        return false;
+    }
+    return true;
+}
+
+// Fonction principale : lance le serveur, exécute les vérifications, puis arrête le serveur
+int main(int argc, char* argv[]) {
+    const char* server_path = argc > 1 ? argv[1] : "./server";
+    const char* port = argc > 2 ? argv[2] : "32100";
+    if (argc > 3) {
+        fprintf(stderr, "Utilisation : %s [serveur] [port]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (start_server(server_path, port) == -1) {
+        fprintf(stderr, "Impossible de lancer %s sur le port %s\n", server_path, port);
+        exit(EXIT_FAILURE);
+    }
+
+    bool legacy_ok = check_legacy_client(port);
+    bool compact_ok = check_compact_client(port);
+    kill(server_pid, SIGTERM);
+    waitpid(server_pid, NULL, 0);
+
+    printf("historique silencieux toujours connecté : %s\n", legacy_ok ? "ok" : "ÉCHEC");
+    printf("compact sans PONG déconnecté            : %s\n", compact_ok ? "ok" : "ÉCHEC");
+    return legacy_ok && compact_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,72 @@
+//metrics.h
+// Compteurs et histogrammes du serveur, exposés au format texte de Prometheus
+// Chaque réacteur tient ses propres compteurs et il est seul à les incrémenter : une lecture et une
+// écriture relâchées suffisent, sans instruction atomique verrouillée sur le chemin des messages.
+// Le lecteur (la socket d'administration) additionne les réacteurs.
+// Histogrammes à une case par puissance de deux : la case i compte les valeurs 2^(i-1) < v <= 2^i
+// (la case 0 compte v <= 1), ce qui donne directement les bornes « le » de Prometheus.
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define METRIC_HIST_BUCKETS 48
+
+typedef struct Histogram {
+    atomic_ulong buckets[METRIC_HIST_BUCKETS];
+    atomic_ulong sum;
+} Histogram;
+
+// Fonction pour ajouter n à un compteur dont le thread appelant est le seul écrivain
+static inline void counter_add(atomic_ulong* counter, unsigned long n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Fonction pour lire un compteur (depuis n'importe quel thread)
+static inline unsigned long counter_get(atomic_ulong* counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+// Fonction pour noter une valeur dans un histogramme dont le thread appelant est le seul écrivain
+static inline void histogram_observe(Histogram* hist, unsigned long value) {
+    int bucket = value <= 1 ? 0 : 64 - __builtin_clzl(value - 1);
+    if (bucket >= METRIC_HIST_BUCKETS) {
+        bucket = METRIC_HIST_BUCKETS - 1;
+    }
+    counter_add(&hist->buckets[bucket], 1);
+    counter_add(&hist->sum, value);
+}
+
+// Fonction pour ajouter un histogramme à un cumul (buckets et sum), pour additionner les réacteurs
+static void histogram_merge(unsigned long* buckets, unsigned long* sum, Histogram* hist) {
+    for (int i = 0; i < METRIC_HIST_BUCKETS; i++) {
+        buckets[i] += counter_get(&hist->buckets[i]);
+    }
+    *sum += counter_get(&hist->sum);
+}
+
+// Fonction pour écrire l'en-tête d'une famille de métriques
+static void metrics_write_header(FILE* out, const char* name, const char* type, const char* help) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Fonction pour écrire un histogramme cumulé ; labels est vide ou de la forme type="X"
+// Les bornes publiées sont 2^first à 2^last, multipliées par scale (par exemple 1e-9 pour des secondes)
+static void metrics_write_histogram(FILE* out, const char* name, const char* labels, const unsigned long* buckets,
+                                    unsigned long sum, int first, int last, double scale) {
+    unsigned long cumulative = 0;
+    unsigned long total = 0;
+    for (int i = 0; i < METRIC_HIST_BUCKETS; i++) {
+        total += buckets[i];
+    }
+    for (int i = 0; i <= last && i < METRIC_HIST_BUCKETS; i++) {
+        cumulative += buckets[i];
+        if (i >= first) {
+            fprintf(out, "%s_bucket{%s%sle=\"%.9g\"} %lu\n", name, labels, labels[0] ? "," : "", (double)(1UL << i) * scale, cumulative);
+        }
+    }
+    fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, labels[0] ? "," : "", total);
+    if (labels[0]) {
+        fprintf(out, "%s_sum{%s} %.17g\n%s_count{%s} %lu\n", name, labels, sum * scale, name, labels, total);
+    } else {
+        fprintf(out, "%s_sum %.17g\n%s_count %lu\n", name, sum * scale, name, total);
+    }
+}
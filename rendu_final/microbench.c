@@ -0,0 +1,353 @@
+//microbench.c
+// Microbenchmarks des fonctions chaudes du serveur, mesurées dans le processus
+// server.c est inclus tel quel (sans son main) : on mesure exactement le code du serveur.
+//   send_legacy_message / receive_legacy_message (wire.h, client) : sur une paire de sockets locales, par lots
+//   is_nickname_taken : annuaire synthétique de N clients, pseudos présents et absents
+//   channel_exists / count_clients_in_channel : registre synthétique de N salons
+//   trace_event / trace_sampled : traces retenues, écartées par niveau ou par échantillonnage ; sans thread
+//   d'écriture, la file est vidée vers /dev/null entre deux lots, hors mesure
+// Chaque mesure est précédée d'un échauffement, puis répétée ; on affiche le temps par opération
+// (médiane, minimum et maximum des répétitions), à comparer avant et après une modification.
+#define CHAT_NO_MAIN
+#include "server.c"
+#include "wire.h"
+
+#define BENCH_BATCH 32
+#define BENCH_PAYLOAD 64
+#define BENCH_MAX_REPS 100
+
+typedef struct BenchCase {
+    const char* name;
+    const char* param;
+    // Exécute iterations opérations ; retourne la durée mesurée en nanosecondes
+    long long (*run)(void* ctx, long iterations);
+    void* ctx;
+} BenchCase;
+
+// Paramètres de la mesure
+static int bench_reps = 10;
+static long bench_warmup_ms = 100;
+static long bench_rep_ms = 50;
+static const char* bench_filter = NULL;
+static volatile long bench_sink;
+
+// Fonction pour lire l'horloge monotone en nanosecondes
+static long long bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Fonction pour comparer deux durées (tri des répétitions)
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Fonction pour mesurer un cas : échauffement, calibrage du nombre d'itérations, puis répétitions
+static void bench_case(const BenchCase* bench) {
+    if (bench_filter && !strstr(bench->name, bench_filter)) {
+        return;
+    }
+
+    // Échauffement, qui sert aussi à estimer le coût d'une opération
+    long iterations = 1;
+    long long elapsed = 0;
+    long long warmup_end = bench_now_ns() + bench_warmup_ms * 1000000LL;
+    while (bench_now_ns() < warmup_end) {
+        elapsed = bench->run(bench->ctx, iterations);
+        if (elapsed < bench_rep_ms * 1000000LL / 4) {
+            iterations *= 2;
+        }
+    }
+    double ns_per_op = elapsed > 0 ? (double)elapsed / iterations : 1;
+    iterations = (long)(bench_rep_ms * 1000000.0 / ns_per_op);
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    double samples[BENCH_MAX_REPS];
+    for (int r = 0; r < bench_reps; r++) {
+        samples[r] = (double)bench->run(bench->ctx, iterations) / iterations;
+    }
+    qsort(samples, bench_reps, sizeof(double), compare_double);
+    printf("%-32s %-14s %10.1f %10.1f %10.1f %12ld\n", bench->name, bench->param,
+           samples[bench_reps / 2], samples[0], samples[bench_reps - 1], iterations);
+}
+
+// Paire de sockets locales : le serveur écrit sur fds[0], le client lit sur fds[1]
+typedef struct SocketCtx {
+    int fds[2];
+    struct message msg;
+    char payload[BENCH_PAYLOAD];
+} SocketCtx;
+
+// Fonction pour vider une socket de ce qu'elle contient (hors mesure)
+static void drain_socket(int fd, size_t len) {
+    char buf[BENCH_BATCH * (sizeof(struct message) + BENCH_PAYLOAD)];
+    while (len > 0) {
+        ssize_t ret = read(fd, buf, len < sizeof(buf) ? len : sizeof(buf));
+        if (ret <= 0) {
+            perror("read");
+            exit(EXIT_FAILURE);
+        }
+        len -= ret;
+    }
+}
+
+// Fonction pour mesurer send_legacy_message : un lot par tour, vidé hors mesure
+static long long run_send(void* arg, long iterations) {
+    SocketCtx* ctx = arg;
+    size_t frame_len = sizeof(struct message) + (ctx->msg.pld_len > 0 ? ctx->msg.pld_len : 0);
+    long long total = 0;
+    for (long done = 0; done < iterations; done += BENCH_BATCH) {
+        long batch = iterations - done < BENCH_BATCH ? iterations - done : BENCH_BATCH;
+        long long start = bench_now_ns();
+        for (long i = 0; i < batch; i++) {
+            bench_sink += send_legacy_message(ctx->fds[0], &ctx->msg, ctx->payload);
+        }
+        total += bench_now_ns() - start;
+        drain_socket(ctx->fds[1], batch * frame_len);
+    }
+    return total;
+}
+
+// Fonction pour mesurer receive_legacy_message : un lot écrit hors mesure, puis relu
+static long long run_receive(void* arg, long iterations) {
+    SocketCtx* ctx = arg;
+    struct message msg;
+    char payload[MSG_LEN];
+    long long total = 0;
+    for (long done = 0; done < iterations; done += BENCH_BATCH) {
+        long batch = iterations - done < BENCH_BATCH ? iterations - done : BENCH_BATCH;
+        for (long i = 0; i < batch; i++) {
+            send_legacy_message(ctx->fds[1], &ctx->msg, ctx->payload);
+        }
+        long long start = bench_now_ns();
+        for (long i = 0; i < batch; i++) {
+            bench_sink += receive_legacy_message(ctx->fds[0], &msg, payload, sizeof(payload), NULL);
+        }
+        total += bench_now_ns() - start;
+    }
+    return total;
+}
+
+// Fonction pour préparer une paire de sockets et le message échangé
+static void socket_ctx_init(SocketCtx* ctx, int payload_len) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, ctx->fds) == -1) {
+        perror("socketpair()");
+        exit(EXIT_FAILURE);
+    }
+    memset(&ctx->msg, 0, sizeof(ctx->msg));
+    ctx->msg.type = UNICAST_SEND;
+    ctx->msg.pld_len = payload_len;
+    strncpy(ctx->msg.nick_sender, "bench", NICK_LEN - 1);
+    strncpy(ctx->msg.infos, "destinataire", INFOS_LEN - 1);
+    memset(ctx->payload, 'x', sizeof(ctx->payload));
+}
+
+// Annuaire ou registre synthétique de count entrées, et noms à chercher
+typedef struct TableCtx {
+    int count;
+    bool hit;
+    char (*names)[NICK_LEN];
+    int lookups;
+} TableCtx;
+
+// Fonction pour préparer les noms à chercher : existants (hit) ou inconnus de la table
+static void table_ctx_init(TableCtx* ctx, int count, bool hit, const char* prefix) {
+    ctx->count = count;
+    ctx->hit = hit;
+    ctx->lookups = 1024;
+    ctx->names = malloc(ctx->lookups * sizeof(*ctx->names));
+    if (!ctx->names) {
+        perror("Échec d'allocation mémoire");
+        exit(EXIT_FAILURE);
+    }
+    // Les recherches parcourent la table dans un ordre dispersé, pour ne pas rester dans le cache
+    for (int i = 0; i < ctx->lookups; i++) {
+        int index = (int)((i * 2654435761UL) % count);
+        snprintf(ctx->names[i], NICK_LEN, hit ? "%s%d" : "%s%d_absent", prefix, index);
+    }
+}
+
+// Fonction pour mesurer is_nickname_taken
+static long long run_nickname(void* arg, long iterations) {
+    TableCtx* ctx = arg;
+    long found = 0;
+    long long start = bench_now_ns();
+    for (long i = 0; i < iterations; i++) {
+        found += is_nickname_taken(ctx->names[i & (ctx->lookups - 1)], NULL);
+    }
+    long long elapsed = bench_now_ns() - start;
+    bench_sink += found;
+    return elapsed;
+}
+
+// Fonction pour mesurer channel_exists
+static long long run_channel_exists(void* arg, long iterations) {
+    TableCtx* ctx = arg;
+    long found = 0;
+    long long start = bench_now_ns();
+    for (long i = 0; i < iterations; i++) {
+        found += channel_exists(ctx->names[i & (ctx->lookups - 1)]);
+    }
+    long long elapsed = bench_now_ns() - start;
+    bench_sink += found;
+    return elapsed;
+}
+
+// Fonction pour mesurer count_clients_in_channel
+static long long run_count_clients(void* arg, long iterations) {
+    TableCtx* ctx = arg;
+    long members = 0;
+    long long start = bench_now_ns();
+    for (long i = 0; i < iterations; i++) {
+        members += count_clients_in_channel(ctx->names[i & (ctx->lookups - 1)]);
+    }
+    long long elapsed = bench_now_ns() - start;
+    bench_sink += members;
+    return elapsed;
+}
+
+static FILE* bench_trace_out;
+
+// Fonction pour mesurer une trace, par lots assez petits pour ne jamais remplir la file
+// ctx vaut le niveau de la trace ; les traces échantillonnées passent par trace_sampled
+static long long run_trace(void* arg, long iterations, bool sampled) {
+    int level = (int)(long)arg;
+    long long elapsed = 0;
+    for (long done = 0; done < iterations;) {
+        long batch = iterations - done < TRACE_RING_SIZE / 2 ? iterations - done : TRACE_RING_SIZE / 2;
+        long long start = bench_now_ns();
+        for (long i = 0; i < batch; i++) {
+            if (sampled) {
+                trace_sampled(level, "Message privé envoyé de %s à %s (%d octets).", "expediteur", "destinataire", i);
+            } else {
+                trace_event(level, "Message privé envoyé de %s à %s (%d octets).", "expediteur", "destinataire", i);
+            }
+        }
+        elapsed += bench_now_ns() - start;
+        done += batch;
+        trace_drain(bench_trace_out);
+    }
+    return elapsed;
+}
+
+static long long run_trace_event(void* arg, long iterations) {
+    return run_trace(arg, iterations, false);
+}
+
+static long long run_trace_sampled(void* arg, long iterations) {
+    return run_trace(arg, iterations, true);
+}
+
+// Fonction pour remplir l'annuaire des pseudonymes jusqu'à count clients synthétiques
+static void fill_directory(int count) {
+    static int filled = 0;
+    for (; filled < count; filled++) {
+        ClientNode* node = slab_alloc(sizeof(ClientNode));
+        memset(node, 0, sizeof(ClientNode));
+        node->info = slab_alloc(sizeof(ClientInfo));
+        memset(node->info, 0, sizeof(ClientInfo));
+        snprintf(node->info->nickname, NICK_LEN, "user%d", filled);
+        nick_index_insert(node);
+    }
+}
+
+// Fonction pour remplir le registre jusqu'à count salons synthétiques, chacun avec quelques membres
+static void fill_channels(int count) {
+    static int filled = 0;
+    static ClientNode members[8];
+    for (; filled < count; filled++) {
+        char name[CHANNEL_LEN];
+        snprintf(name, sizeof(name), "salon%d", filled);
+        Channel* channel = create_channel(name);
+        for (int m = 0; m <= filled % 8; m++) {
+            channel_add_member(channel, &members[m]);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "r:w:m:f:")) != -1) {
+        if (opt == 'r' && atoi(optarg) > 0 && atoi(optarg) <= BENCH_MAX_REPS) {
+            bench_reps = atoi(optarg);
+        } else if (opt == 'w' && atol(optarg) >= 0) {
+            bench_warmup_ms = atol(optarg);
+        } else if (opt == 'm' && atol(optarg) > 0) {
+            bench_rep_ms = atol(optarg);
+        } else if (opt == 'f') {
+            bench_filter = optarg;
+        } else {
+            fprintf(stderr, "Utilisation : %s [-r répétitions] [-w échauffement_ms] [-m durée_répétition_ms] [-f filtre]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("%-32s %-14s %10s %10s %10s %12s\n", "fonction", "cas", "ns/op", "min", "max", "tours");
+
+    SocketCtx header_only, with_payload;
+    socket_ctx_init(&header_only, 0);
+    socket_ctx_init(&with_payload, BENCH_PAYLOAD);
+    BenchCase socket_cases[] = {
+        {"send_legacy_message", "en-tête", run_send, &header_only},
+        {"send_legacy_message", "64 octets", run_send, &with_payload},
+        {"receive_legacy_message", "en-tête", run_receive, &header_only},
+        {"receive_legacy_message", "64 octets", run_receive, &with_payload},
+    };
+    for (size_t i = 0; i < sizeof(socket_cases) / sizeof(socket_cases[0]); i++) {
+        bench_case(&socket_cases[i]);
+    }
+
+    // Mêmes réglages que trace_start(), sans lancer le thread d'écriture
+    bench_trace_out = fopen("/dev/null", "w");
+    if (bench_trace_out) {
+        for (unsigned long i = 0; i < TRACE_RING_SIZE; i++) {
+            atomic_init(&trace_ring[i].seq, i);
+        }
+        trace_level = TRACE_INFO;
+        trace_sample_rate = 64;
+        BenchCase trace_cases[] = {
+            {"trace_event", "retenue", run_trace_event, (void*)(long)TRACE_INFO},
+            {"trace_event", "hors niveau", run_trace_event, (void*)(long)TRACE_DEBUG},
+            {"trace_sampled", "1 sur 64", run_trace_sampled, (void*)(long)TRACE_INFO},
+        };
+        for (size_t i = 0; i < sizeof(trace_cases) / sizeof(trace_cases[0]); i++) {
+            bench_case(&trace_cases[i]);
+        }
+    }
+
+    // Les tables grandissent d'une taille à l'autre : chaque mesure voit la table complète
+    static const int sizes[] = {10, 1000, 100000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        char param_hit[32], param_miss[32];
+        snprintf(param_hit, sizeof(param_hit), "%d, existant", sizes[s]);
+        snprintf(param_miss, sizeof(param_miss), "%d, inconnu", sizes[s]);
+
+        fill_directory(sizes[s]);
+        fill_channels(sizes[s]);
+        TableCtx nick_hit, nick_miss, chan_hit, chan_miss;
+        table_ctx_init(&nick_hit, sizes[s], true, "user");
+        table_ctx_init(&nick_miss, sizes[s], false, "user");
+        table_ctx_init(&chan_hit, sizes[s], true, "salon");
+        table_ctx_init(&chan_miss, sizes[s], false, "salon");
+        BenchCase table_cases[] = {
+            {"is_nickname_taken", param_hit, run_nickname, &nick_hit},
+            {"is_nickname_taken", param_miss, run_nickname, &nick_miss},
+            {"channel_exists", param_hit, run_channel_exists, &chan_hit},
+            {"channel_exists", param_miss, run_channel_exists, &chan_miss},
+            {"count_clients_in_channel", param_hit, run_count_clients, &chan_hit},
+            {"count_clients_in_channel", param_miss, run_count_clients, &chan_miss},
+        };
+        for (size_t i = 0; i < sizeof(table_cases) / sizeof(table_cases[0]); i++) {
+            bench_case(&table_cases[i]);
+        }
+        free(nick_hit.names);
+        free(nick_miss.names);
+        free(chan_hit.names);
+        free(chan_miss.names);
+    }
+    exit(EXIT_SUCCESS);
+}
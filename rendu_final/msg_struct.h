@@ -24,6 +24,9 @@ enum msg_type {
 	FILE_REJECT,
 	FILE_SEND,
 	FILE_ACK,
+	PING,
+	PONG,
+	MULTICAST_HISTORY,
 };
 
 struct message {
@@ -55,4 +58,7 @@ char* msg_type_str[] = {
 	"FILE_REJECT",
 	"FILE_SEND",
 	"FILE_ACK",
+	"PING",
+	"PONG",
+	"MULTICAST_HISTORY",
 };
\ No newline at end of file
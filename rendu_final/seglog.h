@@ -0,0 +1,488 @@
+//seglog.h
+// Journal en ajout seul, découpé en segments de SEGLOG_SEGMENT_SIZE octets projetés en mémoire (mmap)
+// Chaque segment est un fichier <dossier>/<numéro>.seg, alloué d'avance ; un enregistrement vaut :
+//   u32  longueur totale, en-tête compris ; posée avec SEGLOG_PENDING dès la réservation, puis sans
+//        une fois les données copiées (0 : place tout juste réservée ; SEGLOG_END : le reste du segment
+//        est vide, l'enregistrement suivant est dans le segment d'après)
+//   u32  flux (voir l'appelant)
+//   i64  horodatage (ms depuis l'époque)
+//   données, complétées jusqu'au multiple de 8 suivant
+// Un enregistrement est repéré par sa position logique : numéro de segment * SEGLOG_SEGMENT_SIZE + décalage.
+// Les écrivains (un par réacteur) réservent leur place par un simple fetch_add puis copient sans verrou ;
+// le segment suivant est préparé d'avance par un thread de fond, qui se charge aussi des msync()
+// et de supprimer les vieux segments : aucune entrée-sortie bloquante dans les boucles d'événements.
+// Seuls les keep derniers segments sont gardés, sur disque comme en mémoire ; au redémarrage,
+// ceux qui restent dans le dossier sont projetés de nouveau et relus.
+// Un segment n'est démonté qu'une fois son compteur d'utilisateurs (écrivains en cours, curseurs) à zéro :
+// c'est le thread de fond qui attend, jamais un réacteur.
+// Les curseurs parcourent les enregistrements en place dans les pages projetées (voir LogCursor).
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SEGLOG_SEGMENT_SIZE (16 * 1024 * 1024)
+// Segments gardés (projetés, donc lisibles) par défaut, et au plus ; les plus anciens sont supprimés
+#define SEGLOG_KEEP_SEGMENTS 8
+#define SEGLOG_MAX_KEEP 64
+#define SEGLOG_MAX_SEGMENTS (SEGLOG_MAX_KEEP + 2)
+// Période des msync(MS_ASYNC) du segment courant par le thread de fond
+#define SEGLOG_SYNC_INTERVAL_MS 1000
+#define SEGLOG_NONE UINT64_MAX
+#define SEGLOG_END UINT32_MAX
+#define SEGLOG_PENDING 0x80000000u
+// Attente bornée d'un écrivain qui vient de réserver sa place sans l'avoir encore marquée
+#define SEGLOG_RESERVE_SPINS 64
+
+typedef struct LogRecord {
+    _Atomic uint32_t len;
+    uint32_t stream;
+    int64_t time_ms;
+    char data[];
+} LogRecord;
+
+typedef struct LogSegment {
+    uint64_t seq;
+    int fd;
+    char* map;
+    atomic_size_t reserved;
+    // Écrivains en train de copier dans le segment et curseurs ouverts dessus
+    atomic_uint users;
+    bool synced;
+    // Chaînage des segments démontés, réutilisés par le thread de fond
+    struct LogSegment* next_free;
+} LogSegment;
+
+typedef struct SegLog {
+    char dir[256];
+    // Protège la liste des segments, le segment de réserve, et réveille le thread de fond
+    pthread_mutex_t roll_lock;
+    pthread_cond_t roll_cond;
+    LogSegment* _Atomic current;
+    LogSegment* spare;
+    // Segments démontés (thread de fond seulement) : jamais libérés, un écrivain en retard
+    // peut encore incrémenter leur compteur avant de voir qu'ils ne sont plus courants
+    LogSegment* free_segments;
+    LogSegment* segments[SEGLOG_MAX_SEGMENTS];
+    unsigned int segment_count;
+    unsigned int keep;
+    uint64_t next_seq;
+    // Numéro du plus ancien segment encore gardé
+    _Atomic uint64_t oldest_seq;
+    atomic_ulong appended;
+    atomic_ulong dropped;
+    pthread_t thread;
+} SegLog;
+
+// Curseur de lecture : tant qu'il est ouvert, les segments qu'il voit restent projetés
+// et les pointeurs rendus par seglog_cursor_next() restent valides
+typedef struct LogCursor {
+    SegLog* log;
+    LogSegment* segments[SEGLOG_MAX_SEGMENTS];
+    unsigned int count;
+} LogCursor;
+
+// Fonction pour lire l'heure murale en millisecondes
+static int64_t seglog_wall_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Fonction pour écrire dans path le chemin du fichier du segment numéro seq
+static void seglog_segment_path(SegLog* log, uint64_t seq, char* path, size_t size) {
+    snprintf(path, size, "%s/%020llu.seg", log->dir, (unsigned long long)seq);
+}
+
+// Fonction pour trouver une structure de segment libre (réutilisée ou allouée) pour le segment seq
+static LogSegment* seglog_segment_new(SegLog* log, uint64_t seq, int fd, char* map) {
+    LogSegment* seg = log->free_segments;
+    if (seg) {
+        // users n'est pas remis à zéro : un écrivain en retard peut encore le tenir un instant
+        log->free_segments = seg->next_free;
+        atomic_store(&seg->reserved, 0);
+        seg->synced = false;
+    } else if (!(seg = calloc(1, sizeof(LogSegment)))) {
+        perror("Échec d'allocation mémoire pour un segment du journal");
+        exit(EXIT_FAILURE);
+    }
+    seg->seq = seq;
+    seg->fd = fd;
+    seg->map = map;
+    return seg;
+}
+
+// Fonction pour créer, allouer sur disque et projeter le segment numéro seq ; NULL en cas d'échec
+static LogSegment* seglog_segment_open(SegLog* log, uint64_t seq) {
+    char path[512];
+    seglog_segment_path(log, seq, path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        perror("open(segment)");
+        return NULL;
+    }
+    int err = posix_fallocate(fd, 0, SEGLOG_SEGMENT_SIZE);
+    if (err != 0) {
+        fprintf(stderr, "posix_fallocate(segment): %s\n", strerror(err));
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    // MAP_POPULATE fait les défauts de page ici, sur le thread de fond, plutôt qu'au premier ajout
+    char* map = mmap(NULL, SEGLOG_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap(segment)");
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    return seglog_segment_new(log, seq, fd, map);
+}
+
+// Fonction pour projeter de nouveau le segment seq laissé par une exécution précédente ;
+// NULL s'il est illisible ou vide (segment de réserve jamais utilisé)
+// Sa fin est retrouvée en suivant les longueurs, puis marquée par SEGLOG_END : plus rien n'y est ajouté.
+// Un enregistrement resté SEGLOG_PENDING (arrêt pendant la copie) est sauté ; une place réservée
+// mais jamais marquée ne peut pas l'être, le reste du segment est alors perdu.
+static LogSegment* seglog_segment_load(SegLog* log, uint64_t seq) {
+    char path[512];
+    seglog_segment_path(log, seq, path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        perror("open(segment)");
+        return NULL;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    char* map = size == SEGLOG_SEGMENT_SIZE ? mmap(NULL, SEGLOG_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Segment %s illisible, ignoré\n", path);
+        close(fd);
+        return NULL;
+    }
+    size_t pos = 0;
+    while (pos < SEGLOG_SEGMENT_SIZE) {
+        LogRecord* rec = (LogRecord*)(map + pos);
+        uint32_t len = atomic_load(&rec->len);
+        if (len == SEGLOG_END) {
+            break;
+        }
+        len &= ~SEGLOG_PENDING;
+        if (len < sizeof(LogRecord) || len % 8 != 0 || len > SEGLOG_SEGMENT_SIZE - pos) {
+            atomic_store(&rec->len, SEGLOG_END);
+            break;
+        }
+        pos += len;
+    }
+    if (pos == 0) {
+        munmap(map, SEGLOG_SEGMENT_SIZE);
+        close(fd);
+        return NULL;
+    }
+    LogSegment* seg = seglog_segment_new(log, seq, fd, map);
+    atomic_store(&seg->reserved, SEGLOG_SEGMENT_SIZE);
+    return seg;
+}
+
+// Fonction pour démonter un segment retiré de la liste et supprimer son fichier (thread de fond)
+// Attend d'abord que les écrivains et curseurs qui le tiennent encore en soient sortis
+static void seglog_segment_close(SegLog* log, LogSegment* seg) {
+    while (atomic_load(&seg->users) > 0) {
+        sched_yield();
+    }
+    char path[512];
+    seglog_segment_path(log, seg->seq, path, sizeof(path));
+    munmap(seg->map, SEGLOG_SEGMENT_SIZE);
+    close(seg->fd);
+    unlink(path);
+    seg->map = NULL;
+    seg->next_free = log->free_segments;
+    log->free_segments = seg;
+}
+
+// Fonction de comparaison de deux numéros de segment, pour qsort()
+static int seglog_compare_seq(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Fonction pour relire le dossier du journal : les keep - 1 derniers segments sont projetés de nouveau,
+// les plus anciens et les vides supprimés ; next_seq suit le plus récent
+static void seglog_load_segments(SegLog* log) {
+    DIR* d = opendir(log->dir);
+    if (!d) {
+        return;
+    }
+    uint64_t* seqs = NULL;
+    size_t count = 0, cap = 0;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        unsigned long long seq;
+        char suffix[8];
+        if (sscanf(entry->d_name, "%llu.%7s", &seq, suffix) != 2 || strcmp(suffix, "seg") != 0) {
+            continue;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 16;
+            if (!(seqs = realloc(seqs, cap * sizeof(uint64_t)))) {
+                perror("Échec d'allocation mémoire pour les segments du journal");
+                exit(EXIT_FAILURE);
+            }
+        }
+        seqs[count++] = seq;
+    }
+    closedir(d);
+    qsort(seqs, count, sizeof(uint64_t), seglog_compare_seq);
+
+    // Du plus récent au plus ancien : la place du segment neuf est réservée dans les keep
+    LogSegment* loaded[SEGLOG_MAX_KEEP];
+    unsigned int loaded_count = 0;
+    for (size_t i = count; i-- > 0;) {
+        LogSegment* seg = loaded_count + 1 < log->keep ? seglog_segment_load(log, seqs[i]) : NULL;
+        if (seg) {
+            loaded[loaded_count++] = seg;
+        } else {
+            char path[512];
+            seglog_segment_path(log, seqs[i], path, sizeof(path));
+            unlink(path);
+        }
+    }
+    while (loaded_count > 0) {
+        log->segments[log->segment_count++] = loaded[--loaded_count];
+    }
+    if (count > 0) {
+        log->next_seq = seqs[count - 1] + 1;
+    }
+    free(seqs);
+}
+
+// Thread de fond : prépare le segment de réserve, synchronise les segments pleins
+// et supprime ceux qui dépassent les keep derniers
+static void* seglog_thread(void* arg) {
+    SegLog* log = arg;
+    while (1) {
+        pthread_mutex_lock(&log->roll_lock);
+        if (log->spare && log->segment_count <= log->keep) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += SEGLOG_SYNC_INTERVAL_MS / 1000;
+            pthread_cond_timedwait(&log->roll_cond, &log->roll_lock, &deadline);
+        }
+        bool need_spare = log->spare == NULL;
+        uint64_t seq = log->next_seq;
+        LogSegment* current = atomic_load(&log->current);
+        LogSegment* to_sync[SEGLOG_MAX_SEGMENTS];
+        unsigned int sync_count = 0;
+        for (unsigned int i = 0; i < log->segment_count; i++) {
+            if (log->segments[i] != current && !log->segments[i]->synced) {
+                log->segments[i]->synced = true;
+                to_sync[sync_count++] = log->segments[i];
+            }
+        }
+        pthread_mutex_unlock(&log->roll_lock);
+
+        if (need_spare) {
+            LogSegment* seg = seglog_segment_open(log, seq);
+            pthread_mutex_lock(&log->roll_lock);
+            log->spare = seg;
+            log->next_seq = seq + 1;
+            pthread_mutex_unlock(&log->roll_lock);
+            if (!seg) {
+                // Disque plein ou dossier inaccessible : les ajouts sont abandonnés en attendant
+                sleep(1);
+            }
+        }
+        for (unsigned int i = 0; i < sync_count; i++) {
+            msync(to_sync[i]->map, SEGLOG_SEGMENT_SIZE, MS_ASYNC);
+        }
+        if (current) {
+            msync(current->map, atomic_load(&current->reserved) < SEGLOG_SEGMENT_SIZE ? atomic_load(&current->reserved) : SEGLOG_SEGMENT_SIZE, MS_ASYNC);
+        }
+
+        // Le segment le plus ancien n'est jamais le segment courant : une fois retiré de la liste,
+        // aucun nouveau curseur ne le voit et les écrivains qui le rencontrent recommencent
+        while (1) {
+            LogSegment* oldest = NULL;
+            pthread_mutex_lock(&log->roll_lock);
+            if (log->segment_count > log->keep) {
+                oldest = log->segments[0];
+                memmove(log->segments, log->segments + 1, (log->segment_count - 1) * sizeof(LogSegment*));
+                log->segment_count--;
+                atomic_store(&log->oldest_seq, log->segments[0]->seq);
+            }
+            pthread_mutex_unlock(&log->roll_lock);
+            if (!oldest) {
+                break;
+            }
+            seglog_segment_close(log, oldest);
+        }
+    }
+    return NULL;
+}
+
+// Fonction pour ouvrir le journal dans dir, en gardant ses keep derniers segments, et démarrer son thread de fond
+// Les segments d'une exécution précédente sont relus (voir seglog_cursor_next()) ; les ajouts vont dans un segment neuf
+// Retourne -1 si ce segment ne peut pas être créé
+static int seglog_open(SegLog* log, const char* dir, unsigned int keep) {
+    memset(log, 0, sizeof(SegLog));
+    strncpy(log->dir, dir, sizeof(log->dir) - 1);
+    pthread_mutex_init(&log->roll_lock, NULL);
+    pthread_cond_init(&log->roll_cond, NULL);
+    log->keep = keep < 1 ? 1 : keep > SEGLOG_MAX_KEEP ? SEGLOG_MAX_KEEP : keep;
+
+    seglog_load_segments(log);
+    LogSegment* first = seglog_segment_open(log, log->next_seq++);
+    if (!first) {
+        return -1;
+    }
+    log->segments[log->segment_count++] = first;
+    atomic_store(&log->oldest_seq, log->segments[0]->seq);
+    atomic_store(&log->current, first);
+    if (pthread_create(&log->thread, NULL, seglog_thread, log) != 0) {
+        perror("pthread_create(journal)");
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour passer au segment de réserve quand seg est plein
+// Retourne false si aucun segment n'est prêt : l'enregistrement est alors abandonné plutôt que d'attendre
+static bool seglog_roll(SegLog* log, LogSegment* seg) {
+    bool ok = true;
+    pthread_mutex_lock(&log->roll_lock);
+    if (atomic_load(&log->current) == seg) {
+        if (log->spare && log->segment_count < SEGLOG_MAX_SEGMENTS) {
+            log->segments[log->segment_count++] = log->spare;
+            atomic_store(&log->current, log->spare);
+            log->spare = NULL;
+        } else {
+            ok = false;
+        }
+        pthread_cond_signal(&log->roll_cond);
+    }
+    pthread_mutex_unlock(&log->roll_lock);
+    return ok;
+}
+
+// Fonction pour ajouter un enregistrement de len octets au journal
+// Retourne sa position logique, ou SEGLOG_NONE s'il a été abandonné
+static uint64_t seglog_append(SegLog* log, uint32_t stream, const char* data, uint32_t len) {
+    size_t rec_len = (sizeof(LogRecord) + len + 7) & ~(size_t)7;
+    if (rec_len > SEGLOG_SEGMENT_SIZE) {
+        atomic_fetch_add_explicit(&log->dropped, 1, memory_order_relaxed);
+        return SEGLOG_NONE;
+    }
+
+    while (1) {
+        LogSegment* seg = atomic_load(&log->current);
+        // Le segment est retenu avant d'y écrire ; s'il n'est plus courant, il peut être en cours de démontage
+        atomic_fetch_add(&seg->users, 1);
+        if (seg != atomic_load(&log->current)) {
+            atomic_fetch_sub(&seg->users, 1);
+            continue;
+        }
+        size_t off = atomic_fetch_add(&seg->reserved, rec_len);
+        if (off + rec_len <= SEGLOG_SEGMENT_SIZE) {
+            LogRecord* rec = (LogRecord*)(seg->map + off);
+            // La longueur est posée aussitôt : un curseur peut sauter l'enregistrement avant qu'il soit publié
+            atomic_store_explicit(&rec->len, (uint32_t)rec_len | SEGLOG_PENDING, memory_order_relaxed);
+            rec->stream = stream;
+            rec->time_ms = seglog_wall_ms();
+            memcpy(rec->data, data, len);
+            // Publication : un lecteur qui voit len voit aussi le contenu
+            atomic_store_explicit(&rec->len, (uint32_t)rec_len, memory_order_release);
+            atomic_fetch_sub(&seg->users, 1);
+            atomic_fetch_add_explicit(&log->appended, 1, memory_order_relaxed);
+            return seg->seq * SEGLOG_SEGMENT_SIZE + off;
+        }
+        if (off < SEGLOG_SEGMENT_SIZE) {
+            // Premier écrivain à déborder : il marque la fin des données du segment
+            LogRecord* rec = (LogRecord*)(seg->map + off);
+            atomic_store_explicit(&rec->len, SEGLOG_END, memory_order_release);
+        }
+        atomic_fetch_sub(&seg->users, 1);
+        if (!seglog_roll(log, seg)) {
+            atomic_fetch_add_explicit(&log->dropped, 1, memory_order_relaxed);
+            return SEGLOG_NONE;
+        }
+    }
+}
+
+// Fonction pour ouvrir un curseur : les segments projetés à cet instant le restent jusqu'à sa fermeture
+static void seglog_cursor_open(SegLog* log, LogCursor* cursor) {
+    cursor->log = log;
+    pthread_mutex_lock(&log->roll_lock);
+    cursor->count = log->segment_count;
+    for (unsigned int i = 0; i < cursor->count; i++) {
+        cursor->segments[i] = log->segments[i];
+        atomic_fetch_add(&cursor->segments[i]->users, 1);
+    }
+    pthread_mutex_unlock(&log->roll_lock);
+}
+
+// Fonction pour savoir si la position logique offset est dans un segment que voit le curseur
+static bool seglog_cursor_covers(LogCursor* cursor, uint64_t offset) {
+    for (unsigned int i = 0; i < cursor->count; i++) {
+        if (cursor->segments[i]->seq == offset / SEGLOG_SEGMENT_SIZE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Fonction pour lire le premier enregistrement publié à partir de la position logique *offset
+// *offset passe juste après lui ; les enregistrements encore en cours de copie sont sautés
+// NULL à la fin du journal (ou de ce que voit le curseur) ; le pointeur désigne les pages projetées
+static const LogRecord* seglog_cursor_next(LogCursor* cursor, uint64_t* offset) {
+    unsigned int i = 0;
+    while (i < cursor->count) {
+        LogSegment* seg = cursor->segments[i];
+        uint64_t seq = *offset / SEGLOG_SEGMENT_SIZE;
+        size_t pos = *offset % SEGLOG_SEGMENT_SIZE;
+        if (seg->seq < seq) {
+            i++;
+            continue;
+        }
+        if (seg->seq > seq) {
+            // Segment déjà supprimé : la lecture reprend au début du suivant
+            *offset = seg->seq * SEGLOG_SEGMENT_SIZE;
+            continue;
+        }
+        if (pos >= atomic_load(&seg->reserved)) {
+            return NULL;
+        }
+        LogRecord* rec = (LogRecord*)(seg->map + pos);
+        uint32_t len = atomic_load_explicit(&rec->len, memory_order_acquire);
+        for (int spin = 0; len == 0 && spin < SEGLOG_RESERVE_SPINS; spin++) {
+            sched_yield();
+            len = atomic_load_explicit(&rec->len, memory_order_acquire);
+        }
+        if (len == 0) {
+            return NULL;
+        }
+        if (len == SEGLOG_END) {
+            *offset = (seq + 1) * SEGLOG_SEGMENT_SIZE;
+            continue;
+        }
+        *offset += len & ~SEGLOG_PENDING;
+        if (!(len & SEGLOG_PENDING)) {
+            return rec;
+        }
+    }
+    return NULL;
+}
+
+// Fonction pour fermer un curseur ; ses pointeurs ne doivent plus être utilisés
+static void seglog_cursor_close(LogCursor* cursor) {
+    for (unsigned int i = 0; i < cursor->count; i++) {
+        atomic_fetch_sub(&cursor->segments[i]->users, 1);
+    }
+}
@@ -1,4 +1,5 @@
  //server.c
+#define _GNU_SOURCE
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
@@ -6,535 +7,2121 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
-#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <errno.h>
 #include <time.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <sys/eventfd.h>
+#include <signal.h>
+#include <stddef.h>
+#include <sys/un.h>
 #include "msg_struct.h"
+#include "codec.h"
+#include "wheel.h"
+#include "slab.h"
+#include "seglog.h"
+#include "metrics.h"
+#include "trace.h"
 
 #define MSG_LEN 1024
-#define MAX_CLIENTS 100
 #define CHANNEL_LEN 32
-#define MAX_CHANNELS 100
+#define MAX_EVENTS 64
+#define DEFAULT_MAX_QUEUE_BYTES (1024 * 1024)
+#define MAX_PAYLOAD_LEN (MSG_LEN - 1)
+// L'anneau de réception doit pouvoir contenir la plus grande trame, quel que soit le format (puissance de 2)
+#define RX_RING_SIZE 4096
+// Nombre maximal de trames envoyées par un même writev
+#define FLUSH_IOV_MAX 64
+// Délai laissé à une nouvelle connexion pour envoyer son NICKNAME_NEW
+#define HANDSHAKE_TIMEOUT_MS 10000
+// Délai laissé au destinataire d'une demande de transfert de fichier pour y répondre
+#define FILE_REQUEST_TIMEOUT_MS 60000
+#define DEFAULT_KEEPALIVE_MS 30000
+#define DEFAULT_IDLE_TIMEOUT_MS 90000
+// Nombre maximal de salons auxquels un même client peut appartenir
+#define MAX_CHANNELS_PER_CLIENT 64
+// Nombre de parts de l'annuaire ; un pseudo ou un salon appartient à la part hash % DIRECTORY_SHARDS
+#define DIRECTORY_SHARDS 16
+// Taille de l'anneau d'historique de chaque salon, et nombre de messages rejoués par défaut à l'arrivée
+#define CHANNEL_HISTORY_LEN 32
+#define DEFAULT_HISTORY_REPLAY 10
+// Journal des messages (--log-dir) : flux des diffusions et des messages privés ; chaque salon a le sien,
+// tiré de son nom (voir log_channel_stream()) pour rester le même d'une exécution à l'autre
+#define LOG_STREAM_BROADCAST 0
+#define LOG_STREAM_PRIVATE 1
+#define LOG_STREAM_CHANNEL 2
+// Index épars du journal : la position d'un message sur LOG_INDEX_INTERVAL de chaque salon ;
+// une requête /history rend au plus LOG_QUERY_MAX messages
+#define LOG_INDEX_INTERVAL 16
+#define LOG_INDEX_BUCKETS 256
+#define LOG_QUERY_MAX 50
+
+#if RX_RING_SIZE < COMPACT_MAX_FRAME || COMPACT_MAX_PAYLOAD > MAX_PAYLOAD_LEN
+#error "RX_RING_SIZE trop petit pour une trame complète"
+#endif
+
+// État du décodeur de trames d'une connexion
+enum rx_state {
+    RX_HEADER,
+    RX_PAYLOAD,
+};
+
+// Rôle d'une temporisation de la roue d'un réacteur (Timer.kind)
+enum timer_kind {
+    TIMER_CLIENT,
+    TIMER_FILE_REQUEST,
+};
+
+// Nombre de types de messages ; l'indice MSG_TYPE_COUNT des métriques regroupe les types inconnus
+#define MSG_TYPE_COUNT (sizeof(msg_type_str) / sizeof(msg_type_str[0]))
+
+// Motif de fermeture d'une connexion, compté dans les métriques
+enum close_reason {
+    CLOSE_PEER,
+    CLOSE_ERROR,
+    CLOSE_PROTOCOL,
+    CLOSE_NICKNAME,
+    CLOSE_HANDSHAKE_TIMEOUT,
+    CLOSE_IDLE_TIMEOUT,
+    CLOSE_SLOW_CONSUMER,
+    CLOSE_REASON_COUNT,
+};
+
+const char* close_reason_str[CLOSE_REASON_COUNT] = {
+    "peer_closed",
+    "io_error",
+    "protocol_error",
+    "nickname_taken",
+    "handshake_timeout",
+    "idle_timeout",
+    "slow_consumer",
+};
+
+// Politique appliquée quand la file d'envoi d'un client lent est pleine
+enum slow_policy {
+    SLOW_DROP,
+    SLOW_DISCONNECT,
+    SLOW_COALESCE,
+};
+
+// Trame encodée (en-tête + charge utile) en attente d'envoi
+// Immuable une fois construite ; partagée entre les files d'envoi (de tous les réacteurs) par comptage de références
+typedef struct Frame {
+    atomic_uint refcnt;
+    uint8_t type;
+    size_t len;
+    char data[];
+} Frame;
+
+// Diffusion d'un même message : une trame encodée au plus une fois par format,
+// puis placée par référence dans la file de chaque destinataire
+typedef struct Fanout {
+    const struct message* msg;
+    const char* payload;
+    size_t payload_len;
+    unsigned int encoded;
+    unsigned int recipients;
+    Frame* frames[PROTO_COMPACT + 1];
+} Fanout;
+
+// Diffusion à tous les clients, partagée entre les réacteurs (MAIL_BROADCAST) : le message est copié
+// une fois, et chaque format n'est encodé qu'à son premier destinataire, quel que soit son réacteur
+typedef struct Broadcast {
+    atomic_uint refcnt;
+    struct message msg;
+    Frame* _Atomic frames[PROTO_COMPACT + 1];
+} Broadcast;
 
-typedef struct ClientNode {
-    struct pollfd pfd;
-    struct sockaddr_storage client_addr;
+// Partie froide d'un client : lue par /who, /whois, l'identification et les commandes
+// qu'il envoie lui-même, jamais par les diffusions destinées aux autres clients
+typedef struct ClientInfo {
     char nickname[NICK_LEN];
-    time_t connection_time;
-    char channel_name[CHANNEL_LEN];
     char file_transfer_sender[NICK_LEN];
-    struct ClientNode* next;
+    char file_request_target[NICK_LEN];
+    time_t connection_time;
+    struct sockaddr_storage client_addr;
+} ClientInfo;
+
+typedef struct ClientNode {
+    // Ce que touche la livraison d'une trame (queue_frame(), flush_client()) tient en tête de structure
+    int fd;
+    int proto;
+    struct Shard* shard;
+    bool closing;
+    bool identified;
+    // Le client répond aux PING (il a demandé le format compact) : son silence est surveillé par la roue
+    bool keepalive;
+    unsigned int hot_index;
+    // Trames déposées par d'autres réacteurs et pas encore retirées de la boîte aux lettres
+    atomic_uint mail_pending;
+    Frame** outq;
+    unsigned int outq_cap;
+    unsigned int outq_head;
+    unsigned int outq_count;
+    size_t outq_off;
+    size_t outq_bytes;
+    unsigned long dropped_frames;
+    unsigned long id;
+    ClientInfo* info;
+    struct ClientNode* close_next;
+    struct ClientNode* nick_next;
+    // Salons du client (chaînés par Membership.client_next)
+    struct Membership* memberships;
+    unsigned int membership_count;
+    long long handshake_deadline;
+    long long last_activity;
+    Timer timer;
+    Timer file_timer;
+    char* rx_ring;
+    size_t rx_head;
+    size_t rx_tail;
+    enum rx_state rx_state;
+    struct message rx_msg;
 } ClientNode;
 
+// Entrée d'un client dans le tableau dense de son réacteur (Shard.hot) : tout ce qu'une
+// diffusion consulte pour choisir ses destinataires tient en 24 octets
+// Tenue à jour par le seul réacteur propriétaire ; node n'est déréférencé que pour remplir la file
+#define HOT_IDENTIFIED 0x01
+#define HOT_CLOSING 0x02
+typedef struct ClientHot {
+    ClientNode* node;
+    unsigned long id;
+    int fd;
+    uint8_t proto;
+    uint8_t flags;
+} ClientHot;
+
+// Index épars des messages d'un salon dans le journal, retrouvé par le nom du salon : il survit
+// au salon (qui peut être recréé) et est reconstruit au démarrage en relisant le journal
+// Les ajouts du salon se font sous lock : leur ordre dans le journal est celui de leurs numéros
+typedef struct LogChannel {
+    char name[CHANNEL_LEN];
+    uint32_t stream;
+    pthread_mutex_t lock;
+    // Messages numérotés depuis le plus ancien segment relu ; anchors[i] est la position
+    // du message numéro (anchor_base + i) * LOG_INDEX_INTERVAL
+    unsigned long count;
+    unsigned long anchor_base;
+    uint64_t* anchors;
+    unsigned int anchor_count;
+    unsigned int anchor_cap;
+    // Position du dernier message : aucune lecture ne va au-delà
+    uint64_t last;
+    struct LogChannel* next;
+} LogChannel;
+
+// Entrée d'un membre dans le tableau dense de son salon (Channel.roster) : un envoi au salon
+// y lit format et réacteur de chaque destinataire sans parcourir de liste chaînée (32 octets)
+// node n'est déréférencé que pour remplir la file, ou pour savoir si un client du réacteur courant ferme ;
+// membership permet de déplacer l'entrée sans parcourir les salons d'un autre client
+typedef struct ChannelMember {
+    ClientNode* node;
+    struct Shard* shard;
+    struct Membership* membership;
+    int proto;
+} ChannelMember;
+
+// Appartenance d'un client à un salon : maillon de l'ensemble des salons du client (client_next),
+// avec la place du client dans le tableau des membres du salon (Channel.roster[slot])
+// slot peut être modifié par un autre réacteur, sous le verrou de la part du salon en écriture
+typedef struct Membership {
+    ClientNode* client;
+    unsigned int channel_id;
+    unsigned int slot;
+    struct Membership* client_next;
+} Membership;
+
+// Un salon range ses membres de façon contiguë dans roster (member_count entrées)
+// Son nom est interné en un petit entier id, seul recopié dans les appartenances
 typedef struct Channel {
-    char name[INFOS_LEN]; 
+    unsigned int id;
+    char name[CHANNEL_LEN];
+    time_t creation_time;
+    ChannelMember* roster;
+    unsigned int roster_cap;
+    int member_count;
+    // Derniers MULTICAST_SEND relayés, déjà encodés dans chaque format (anneau préalloué)
+    // Les envois au salon se font sous le verrou de sa part en lecture : l'anneau a son propre verrou
+    pthread_mutex_t history_lock;
+    unsigned int history_next;
+    unsigned int history_count;
+    Frame* history[CHANNEL_HISTORY_LEN][PROTO_COMPACT + 1];
+    // Index du salon dans le journal (NULL sans --log-dir)
+    LogChannel* log;
+    struct Channel* hash_next;
+    struct Channel* prev;
+    struct Channel* next;
 } Channel;
 
-ClientNode* head = NULL;
-Channel channels[MAX_CHANNELS];
-int channel_count = 0; 
-
-// Fonction pour envoyer un message complet au client
-ssize_t send_full_message(int server_fd, struct message* msg, const char* payload) {
-    ssize_t total_sent = 0;
-    ssize_t ret;
-    int message_size = sizeof(struct message);
-
-    while (total_sent != message_size) {
-        ret = write(server_fd, (char *)msg + total_sent, message_size - total_sent);
-        if (ret == -1) {
-            perror("write");
-            return -1;
-        }
-        total_sent += ret;
+// Message déposé dans la boîte aux lettres d'un réacteur par un autre réacteur
+enum mail_kind {
+    MAIL_ADOPT,
+    MAIL_FRAME,
+    MAIL_BROADCAST,
+};
+
+// MAIL_ADOPT : prendre en charge client ; MAIL_FRAME : placer frame dans la file de client ;
+// MAIL_BROADCAST : placer broadcast dans la file de chaque client du réacteur sauf exclude_id
+typedef struct Mail {
+    struct Mail* _Atomic next;
+    enum mail_kind kind;
+    ClientNode* client;
+    Frame* frame;
+    unsigned long exclude_id;
+    Broadcast* broadcast;
+} Mail;
+
+// File MPSC sans verrou (Vyukov) : tous les réacteurs y déposent, seul le propriétaire en retire
+typedef struct Mailbox {
+    Mail* _Atomic tail;
+    Mail* head;
+    Mail stub;
+} Mailbox;
+
+// Métriques d'un réacteur, écrites par lui seul (voir metrics.h) ; indexées par enum msg_type
+typedef struct Metrics {
+    atomic_ulong received[MSG_TYPE_COUNT + 1];
+    atomic_ulong received_bytes[MSG_TYPE_COUNT + 1];
+    atomic_ulong sent[MSG_TYPE_COUNT + 1];
+    atomic_ulong sent_bytes[MSG_TYPE_COUNT + 1];
+    atomic_ulong dropped[MSG_TYPE_COUNT + 1];
+    atomic_ulong accepted;
+    atomic_ulong disconnects[CLOSE_REASON_COUNT];
+    // Temps de traitement d'un message reçu (ns), et nombre de destinataires d'une diffusion
+    Histogram handling_ns[MSG_TYPE_COUNT + 1];
+    Histogram fanout[MSG_TYPE_COUNT + 1];
+    // Octets en file chez le destinataire juste après l'ajout d'une trame
+    Histogram queue_depth;
+} Metrics;
+
+// Réacteur : une boucle epoll sur son propre thread, propriétaire d'une partie des clients
+// Seul le propriétaire touche aux files d'envoi, aux anneaux de réception et à l'état de fermeture de ses clients
+typedef struct Shard {
+    int index;
+    int epfd;
+    int listen_fd;
+    int wake_fd;
+    atomic_int wake_pending;
+    pthread_t thread;
+    // Clients du réacteur, rangés de façon contiguë ; ClientNode.hot_index donne leur place
+    ClientHot* hot;
+    unsigned int hot_count;
+    unsigned int hot_cap;
+    ClientNode* closing_list;
+    // Heure monotone du dernier réveil, et temporisations des clients du réacteur
+    long long now;
+    TimerWheel wheel;
+    Mailbox mailbox;
+    Metrics metrics;
+} Shard;
+
+// Part de l'index des pseudonymes : table de hachage à chaînage (via ClientNode.nick_next)
+// Le verrou couvre aussi le pseudo des clients de la part, et garantit qu'un client trouvé
+// n'est pas libéré tant qu'il est tenu
+typedef struct NickShard {
+    pthread_rwlock_t lock;
+    ClientNode** buckets;
+    size_t bucket_count;
+    size_t count;
+} __attribute__((aligned(64))) NickShard;
+
+// Part du registre des salons : table de hachage à chaînage (via Channel.hash_next)
+// Le verrou couvre aussi les membres des salons de la part (roster, member_count, Membership.slot)
+typedef struct ChannelShard {
+    pthread_rwlock_t lock;
+    Channel** buckets;
+    size_t bucket_count;
+    size_t count;
+} __attribute__((aligned(64))) ChannelShard;
+
+// Table des connexions indexée par descripteur, agrandie à la demande ; parcourue par /who sous conn_lock,
+// qui couvre aussi l'écriture des pseudos (un renommage ne doit pas être lu à moitié)
+ClientNode** conn_table = NULL;
+int conn_table_size = 0;
+int conn_max_fd = -1;
+pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
+atomic_int client_count = 0;
+
+// Annuaire partagé par les réacteurs, découpé en DIRECTORY_SHARDS parts selon le hachage du nom :
+// deux messages qui visent des pseudos ou des salons de parts différentes ne se croisent sur aucun verrou
+NickShard nick_shards[DIRECTORY_SHARDS];
+ChannelShard channel_shards[DIRECTORY_SHARDS];
+
+// Liste doublement chaînée de tous les salons pour /channel_list, sous channel_registry_lock
+// avec la table des identifiants ci-dessous
+Channel* channel_list_head = NULL;
+size_t channel_count = 0;
+pthread_mutex_t channel_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Table inverse des identifiants de salon : channel_by_id[id] ; l'identifiant 0 n'est jamais attribué
+// Les identifiants libérés sont réutilisés en priorité, la table ne dépasse donc pas le pic de salons
+Channel** channel_by_id = NULL;
+unsigned int* channel_free_ids = NULL;
+unsigned int channel_free_count = 0;
+unsigned int channel_id_cap = 0;
+unsigned int channel_id_next = 1;
+
+// Champs de transfert de fichier (ClientInfo.file_transfer_sender, file_request_target), modifiés
+// par l'expéditeur comme par le destinataire
+// Ordre de prise des verrous : file_lock, puis les parts des pseudos (par adresse croissante), puis conn_lock ;
+// les parts des salons (par adresse croissante), puis channel_registry_lock. Aucun chemin ne tient
+// à la fois une part des pseudos et une part des salons
+pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Réacteurs (--threads) ; self_shard est celui du thread courant
+Shard* shards = NULL;
+int shard_count = 1;
+int next_shard = 0;
+// --reuseport : chaque réacteur a sa propre socket d'écoute et garde les clients qu'il accepte
+bool reuseport_listeners = false;
+atomic_ulong next_client_id = 1;
+__thread Shard* self_shard = NULL;
+
+// Socket d'administration (--admin) : chaque connexion reçoit les métriques, puis est fermée
+int admin_fd = -1;
+
+size_t max_queue_bytes = DEFAULT_MAX_QUEUE_BYTES;
+long long keepalive_ms = DEFAULT_KEEPALIVE_MS;
+long long idle_timeout_ms = DEFAULT_IDLE_TIMEOUT_MS;
+// --history : nombre de messages rejoués à qui rejoint un salon (0 : historique désactivé)
+unsigned int history_replay = DEFAULT_HISTORY_REPLAY;
+// --log-dir : journal des messages relayés, dont seuls les --log-keep derniers segments sont gardés
+SegLog message_log;
+bool message_log_enabled = false;
+unsigned int log_keep_segments = SEGLOG_KEEP_SEGMENTS;
+// Index épars des salons, par nom ; le verrou ne protège que les chaînes, chaque index a le sien
+LogChannel* log_channels[LOG_INDEX_BUCKETS];
+pthread_mutex_t log_channels_lock = PTHREAD_MUTEX_INITIALIZER;
+// Positionné par SIGUSR1, consommé par la boucle du premier réacteur
+volatile sig_atomic_t stats_requested = 0;
+enum slow_policy slow_consumer_policy = SLOW_DISCONNECT;
+
+// Fonction pour agrandir la table des connexions afin qu'elle contienne l'indice fd
+void conn_table_reserve(int fd) {
+    if (fd < conn_table_size) {
+        return;
+    }
+    int new_size = conn_table_size ? conn_table_size : 64;
+    while (new_size <= fd) {
+        new_size *= 2;
+    }
+    ClientNode** new_table = realloc(conn_table, new_size * sizeof(ClientNode*));
+    if (!new_table) {
+        perror("Échec d'allocation mémoire pour la table des connexions");
+        exit(EXIT_FAILURE);
     }
+    memset(new_table + conn_table_size, 0, (new_size - conn_table_size) * sizeof(ClientNode*));
+    conn_table = new_table;
+    conn_table_size = new_size;
+}
 
-    if (msg->pld_len > 0 && payload != NULL) {
-        ssize_t payload_sent = 0;
-        while (payload_sent != msg->pld_len) {
-            ret = write(server_fd, payload + payload_sent, msg->pld_len - payload_sent);
-            if (ret == -1) {
-                perror("write payload");
-                return -1;
-            }
-            payload_sent += ret;
+// Fonction pour parcourir la table des connexions : renvoie le client suivant à partir de *cursor
+ClientNode* next_client(int* cursor) {
+    while (*cursor <= conn_max_fd) {
+        ClientNode* node = conn_table[(*cursor)++];
+        if (node) {
+            return node;
         }
-        total_sent += payload_sent;
     }
-
-    return total_sent;
+    return NULL;
 }
 
-// Fonction pour recevoir un message complet du client
-ssize_t receive_full_message(int client_fd, struct message* msg, char* payload) {
-    ssize_t total_received = 0;
-    ssize_t ret;
-    int message_size = sizeof(struct message);
+// Fonction pour retrouver l'entrée dense d'un client ; réservée à son réacteur propriétaire
+ClientHot* client_hot(ClientNode* client) {
+    return &client->shard->hot[client->hot_index];
+}
 
-    while (total_received != message_size) {
-        ret = read(client_fd, (char *)msg + total_received, message_size - total_received);
-        if (ret == -1) {
-            perror("read");
-            return -1;
-        }
-        total_received += ret;
+// Fonction pour marquer un client à fermer ; la fermeture effective a lieu
+// à la fin du tour de boucle, pour ne jamais libérer un client en cours de parcours
+// Seul le premier motif est compté
+void close_client(ClientNode* client, enum close_reason reason) {
+    if (client->closing) {
+        return;
     }
+    counter_add(&self_shard->metrics.disconnects[reason], 1);
+    client->closing = true;
+    client_hot(client)->flags |= HOT_CLOSING;
+    client->close_next = self_shard->closing_list;
+    self_shard->closing_list = client;
+}
 
-    if (msg->pld_len > 0 && payload != NULL) {
-        ssize_t payload_received = 0;
-        while (payload_received != msg->pld_len) {
-            ret = read(client_fd, payload + payload_received, msg->pld_len - payload_received);
-            if (ret == -1) {
-                perror("read payload");
-                return -1;
-            }
-            payload_received += ret;
-        }
-        total_received += payload_received;
-    }
+// Fonction pour lire l'horloge monotone, en millisecondes
+long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-    return total_received;
+// Fonction pour lire l'horloge monotone, en nanosecondes (mesure des temps de traitement)
+long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
-// Fonction pour ajouter un nouveau client à la liste des clients
-ClientNode* add_new_client(int fd, struct sockaddr* addr) {
-    ClientNode* new_node = (ClientNode*)malloc(sizeof(ClientNode));
-    if (!new_node) {
-        perror("Échec d'allocation mémoire pour le nouveau client");
-        exit(EXIT_FAILURE);
+// Fonction pour confier la détection d'un pair disparu au keepalive TCP du noyau
+// Réservé aux clients qui ne répondent pas aux PING : les sondes partent après keepalive_ms
+// de silence, et la connexion tombe en erreur vers idle_timeout_ms sans réponse
+void enable_tcp_keepalive(int fd) {
+    int one = 1;
+    int idle = keepalive_ms / 1000 > 0 ? keepalive_ms / 1000 : 1;
+    int count = 3;
+    int interval = (idle_timeout_ms - keepalive_ms) / 1000 / count;
+    if (interval < 1) {
+        interval = 1;
     }
-    new_node->connection_time = time(NULL);
-    new_node->pfd.fd = fd;
-    new_node->pfd.events = POLLIN;
-    if (addr) {
-        memcpy(&(new_node->client_addr), addr, sizeof(struct sockaddr_storage));
-    } else {
-        memset(&(new_node->client_addr), 0, sizeof(struct sockaddr_storage));
+    if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one)) == -1 ||
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) == -1 ||
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) == -1 ||
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count)) == -1) {
+        perror("setsockopt(SO_KEEPALIVE)");
     }
-    new_node->next = head;
-    head = new_node;
+}
 
-    return new_node;
+// Fonction pour passer une socket en mode non bloquant
+int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("fcntl(O_NONBLOCK)");
+        return -1;
+    }
+    return 0;
 }
 
-// Fonction pour supprimer un client de la liste des clients
-void remove_client(ClientNode* node) {
-    if (head == node) {
-        head = node->next;
-    } else {
-        ClientNode* tmp = head;
-        while (tmp->next && tmp->next != node) {
-            tmp = tmp->next;
-        }
-        if (tmp->next) {
-            tmp->next = node->next;
+// Fonction pour encoder un message (en-tête + charge utile) dans une trame au format proto
+Frame* frame_new(int proto, const struct message* msg, const char* payload, size_t payload_len) {
+    char compact[COMPACT_MAX_FRAME];
+    size_t len = sizeof(struct message) + payload_len;
+
+    if (proto == PROTO_COMPACT) {
+        len = compact_encode(msg, payload, payload_len, compact);
+        if (len == 0) {
+            return NULL;
         }
     }
-    free(node);
-}
 
-// Fonction pour vérifier si un pseudonyme est déjà pris par un autre client
-int is_nickname_taken(const char* nickname, ClientNode* current_client) {
-    for (ClientNode* tmp = head; tmp; tmp = tmp->next) {
-        if (tmp != current_client && strcmp(nickname, tmp->nickname) == 0) {
-            return 1;
+    Frame* frame = slab_alloc(sizeof(Frame) + len);
+    if (proto == PROTO_COMPACT) {
+        memcpy(frame->data, compact, len);
+    } else {
+        memcpy(frame->data, msg, sizeof(struct message));
+        if (payload_len > 0) {
+            memcpy(frame->data + sizeof(struct message), payload, payload_len);
         }
     }
-    return 0;
+    atomic_init(&frame->refcnt, 1);
+    frame->type = (unsigned)msg->type < MSG_TYPE_COUNT ? msg->type : MSG_TYPE_COUNT;
+    frame->len = len;
+    return frame;
 }
 
-// Fonction pour gérer le changement de pseudonyme d'un client
-void handle_nick_change(ClientNode* client, const char* new_nickname) {
-    if (is_nickname_taken(new_nickname, client)) {
-        
-        struct message response_msg;
-        response_msg.type = NICKNAME_DOUBLON;
-        send(client->pfd.fd, &response_msg, sizeof(response_msg), 0);
+// Fonction pour faire une trame d'octets déjà encodés (par exemple lus dans le journal)
+Frame* frame_from_wire(const char* data, size_t len) {
+    Frame* frame = slab_alloc(sizeof(Frame) + len);
+    memcpy(frame->data, data, len);
+    atomic_init(&frame->refcnt, 1);
+    // Seules des trames compactes sont relues ainsi : le type est leur troisième octet
+    frame->type = len > 2 && (uint8_t)data[2] < MSG_TYPE_COUNT ? (uint8_t)data[2] : MSG_TYPE_COUNT;
+    frame->len = len;
+    return frame;
+}
 
-        printf("Le client %s a tenté de prendre un pseudonyme déjà utilisé.\n", client->nickname);
-        close(client->pfd.fd);
-        remove_client(client);
-        return;
-    } else {
-        struct message response_msg;
-        response_msg.type = NICKNAME_CHANGEMENT;
-        strncpy(response_msg.infos, new_nickname, NICK_LEN - 1);
+// Fonction pour prendre une référence supplémentaire sur une trame
+Frame* frame_ref(Frame* frame) {
+    atomic_fetch_add_explicit(&frame->refcnt, 1, memory_order_relaxed);
+    return frame;
+}
 
-        strncpy(client->nickname, new_nickname, NICK_LEN - 1);
-        send(client->pfd.fd, &response_msg, sizeof(response_msg), 0);
+// Fonction pour relâcher une référence ; la trame est libérée avec la dernière
+void frame_release(Frame* frame) {
+    if (atomic_fetch_sub_explicit(&frame->refcnt, 1, memory_order_acq_rel) == 1) {
+        slab_free(frame, sizeof(Frame) + frame->len);
     }
 }
 
-// Fonction pour gérer la demande de liste des pseudonymes des clients
-void handle_who_request(ClientNode* client) {
-    struct message msgstruct;
-    msgstruct.type = NICKNAME_LIST;
-    msgstruct.nick_sender[0] = '\0';
-    msgstruct.infos[0] = '\0';
-
-    char online_users[NICK_LEN * MAX_CLIENTS] = {0};
-    char* current_position = online_users;
-
-    for (ClientNode* tmp = head; tmp; tmp = tmp->next) {
-        snprintf(current_position, sizeof(online_users) - (current_position - online_users), " - %s\n", tmp->nickname);
-        current_position += strlen(tmp->nickname) + 4; 
+// Fonction pour jeter la plus ancienne trame de la file qui n'a pas commencé à partir
+void outq_drop_oldest(ClientNode* client) {
+    unsigned int mask = client->outq_cap - 1;
+    unsigned int victim = client->outq_off > 0 ? (client->outq_head + 1) & mask : client->outq_head;
+    Frame* frame = client->outq[victim];
+    if (victim != client->outq_head) {
+        // La trame en cours d'envoi prend la place de celle qu'on jette
+        client->outq[victim] = client->outq[client->outq_head];
     }
+    client->outq_head = (client->outq_head + 1) & mask;
+    client->outq_count--;
+    client->outq_bytes -= frame->len;
+    client->dropped_frames++;
+    counter_add(&self_shard->metrics.dropped[frame->type], 1);
+    frame_release(frame);
+}
+
+// Fonction pour envoyer autant que possible le contenu de la file d'un client
+// Les trames en attente partent par lots de FLUSH_IOV_MAX, un appel système par lot
+// Retourne -1 si la connexion est en erreur
+int flush_client(ClientNode* client) {
+    struct iovec iov[FLUSH_IOV_MAX];
+    unsigned int mask = client->outq_cap - 1;
+
+    while (client->outq_count > 0) {
+        int iovcnt = 0;
+        while (iovcnt < FLUSH_IOV_MAX && (unsigned int)iovcnt < client->outq_count) {
+            Frame* frame = client->outq[(client->outq_head + iovcnt) & mask];
+            size_t off = iovcnt == 0 ? client->outq_off : 0;
+            iov[iovcnt].iov_base = frame->data + off;
+            iov[iovcnt].iov_len = frame->len - off;
+            iovcnt++;
+        }
 
-    strncpy(msgstruct.infos, online_users, sizeof(msgstruct.infos) - 1);
+        // sendmsg() plutôt que writev() : MSG_NOSIGNAL évite un SIGPIPE si le client a fermé
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = iov;
+        mh.msg_iovlen = iovcnt;
+        ssize_t ret = sendmsg(client->fd, &mh, MSG_NOSIGNAL);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // EPOLLOUT signalera quand la socket pourra de nouveau accepter des données
+                return 0;
+            }
+            return -1;
+        }
 
-    if (send(client->pfd.fd, &msgstruct, sizeof(msgstruct), 0) < sizeof(msgstruct)) {
-        perror("send()");
+        // On retire de la file les trames parties en entier ; la dernière peut l'être partiellement
+        size_t sent = ret;
+        while (sent > 0) {
+            Frame* frame = client->outq[client->outq_head];
+            size_t left = frame->len - client->outq_off;
+            if (sent < left) {
+                client->outq_off += sent;
+                break;
+            }
+            sent -= left;
+            client->outq_bytes -= frame->len;
+            frame_release(frame);
+            client->outq_head = (client->outq_head + 1) & mask;
+            client->outq_count--;
+            client->outq_off = 0;
+        }
     }
+    return 0;
 }
 
-// Fonction pour gérer la demande d'informations sur un pseudonyme
-void handle_whois_request(ClientNode* client, const char* target_nickname) {
-    struct message response_msg;
-    memset(&response_msg, 0, sizeof(response_msg));
-    response_msg.type = NICKNAME_INFOS;
+// Fonction pour placer une trame dans la file d'envoi d'un client et tenter de l'envoyer
+// La file récupère la référence de l'appelant sur la trame
+// La file est bornée par max_queue_bytes ; au-delà, la politique de client lent s'applique
+void queue_frame(ClientNode* client, Frame* frame) {
+    if (client->closing) {
+        frame_release(frame);
+        return;
+    }
 
-    for (ClientNode* tmp = head; tmp; tmp = tmp->next) {
-        if (strcmp(target_nickname, tmp->nickname) == 0) {
-            char info_message[INFOS_LEN];
-            struct sockaddr_in* ipv4_addr = (struct sockaddr_in*)&(tmp->client_addr);
-            
-            char ip_str[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &(ipv4_addr->sin_addr), ip_str, INET_ADDRSTRLEN);
-
-            char time_str[64];
-            struct tm* localtime_info = localtime(&(tmp->connection_time));
-            strftime(time_str, sizeof(time_str), "%Y/%m/%d@%H:%M", localtime_info);
-                
-            snprintf(info_message, INFOS_LEN, "[Server] : %s connected since %s with IP address %s and port number %d", 
-                    target_nickname, time_str, ip_str, ntohs(ipv4_addr->sin_port));
-            
-            strncpy(response_msg.infos, info_message, INFOS_LEN - 1);
-            send(client->pfd.fd, &response_msg, sizeof(response_msg), 0);
+    if (client->outq_bytes + frame->len > max_queue_bytes) {
+        if (slow_consumer_policy == SLOW_DISCONNECT) {
+            trace_event(TRACE_WARN, "Client %s trop lent : déconnexion.", client->info->nickname, NULL, 0);
+            counter_add(&self_shard->metrics.dropped[frame->type], 1);
+            frame_release(frame);
+            close_client(client, CLOSE_SLOW_CONSUMER);
+            return;
+        }
+        if (slow_consumer_policy == SLOW_COALESCE) {
+            // On sacrifie les trames les plus anciennes qui n'ont pas commencé à partir
+            unsigned int first = client->outq_off > 0 ? 1 : 0;
+            while (client->outq_count > first && client->outq_bytes + frame->len > max_queue_bytes) {
+                outq_drop_oldest(client);
+            }
+        }
+        if (client->outq_bytes + frame->len > max_queue_bytes) {
+            client->dropped_frames++;
+            counter_add(&self_shard->metrics.dropped[frame->type], 1);
+            frame_release(frame);
             return;
         }
     }
 
-    snprintf(response_msg.infos, INFOS_LEN, "[Server] : Destinataire non trouvé.\n");
-    send(client->pfd.fd, &response_msg, sizeof(response_msg), 0);
+    if (client->outq_count == client->outq_cap) {
+        unsigned int new_cap = client->outq_cap ? client->outq_cap * 2 : 8;
+        Frame** new_queue = slab_alloc(new_cap * sizeof(Frame*));
+        for (unsigned int i = 0; i < client->outq_count; i++) {
+            new_queue[i] = client->outq[(client->outq_head + i) & (client->outq_cap - 1)];
+        }
+        slab_free(client->outq, client->outq_cap * sizeof(Frame*));
+        client->outq = new_queue;
+        client->outq_cap = new_cap;
+        client->outq_head = 0;
+    }
+    client->outq[(client->outq_head + client->outq_count) & (client->outq_cap - 1)] = frame;
+    client->outq_count++;
+    client->outq_bytes += frame->len;
+    Metrics* metrics = &self_shard->metrics;
+    counter_add(&metrics->sent[frame->type], 1);
+    counter_add(&metrics->sent_bytes[frame->type], frame->len);
+    histogram_observe(&metrics->queue_depth, client->outq_bytes);
+
+    if (client->outq_count == 1 && flush_client(client) < 0) {
+        close_client(client, CLOSE_ERROR);
+    }
 }
 
-// Fonction pour diffuser un message à tous les clients
-void broadcast_message(ClientNode* sender, const char* message) {
-    struct message broadcast_msg;
-    memset(&broadcast_msg, 0, sizeof(broadcast_msg));
-    
-    broadcast_msg.type = BROADCAST_SEND;
-    strncpy(broadcast_msg.nick_sender, sender->nickname, NICK_LEN - 1);
+// Fonction pour initialiser une boîte aux lettres vide
+void mailbox_init(Mailbox* box) {
+    atomic_init(&box->stub.next, NULL);
+    box->head = &box->stub;
+    atomic_init(&box->tail, &box->stub);
+}
 
-    strncpy(broadcast_msg.infos, message, INFOS_LEN - 1);
-    
-    broadcast_msg.pld_len = 0;
+// Fonction pour déposer un message ; sûre depuis n'importe quel thread
+void mailbox_push(Mailbox* box, Mail* mail) {
+    atomic_store_explicit(&mail->next, NULL, memory_order_relaxed);
+    Mail* prev = atomic_exchange_explicit(&box->tail, mail, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, mail, memory_order_release);
+}
+
+// Fonction pour retirer le plus ancien message ; réservée au réacteur propriétaire
+// Retourne NULL si la boîte est vide, ou si un dépôt est en cours (son auteur réveillera le réacteur)
+Mail* mailbox_pop(Mailbox* box) {
+    Mail* head = box->head;
+    Mail* next = atomic_load_explicit(&head->next, memory_order_acquire);
 
-    for (ClientNode* tmp = head; tmp; tmp = tmp->next) {
-        if (tmp != sender) {
-            send(tmp->pfd.fd, &broadcast_msg, sizeof(broadcast_msg), 0);
+    if (head == &box->stub) {
+        if (!next) {
+            return NULL;
         }
+        box->head = next;
+        head = next;
+        next = atomic_load_explicit(&head->next, memory_order_acquire);
     }
+    if (next) {
+        box->head = next;
+        return head;
+    }
+    if (head != atomic_load_explicit(&box->tail, memory_order_acquire)) {
+        return NULL;
+    }
+    // Dernier message : on remet la sentinelle derrière lui pour pouvoir le détacher
+    mailbox_push(box, &box->stub);
+    next = atomic_load_explicit(&head->next, memory_order_acquire);
+    if (next) {
+        box->head = next;
+        return head;
+    }
+    return NULL;
 }
 
-// Fonction pour gérer l'envoi d'un message privé à un client spécifique
-void handle_private_message(ClientNode* sender, const char* target_nickname, const char* message) {
-    struct message msgstruct;
-    memset(&msgstruct, 0, sizeof(msgstruct));
-    msgstruct.pld_len = strlen(message);
-    strncpy(msgstruct.nick_sender, sender->nickname, NICK_LEN - 1); // Utilisez le pseudonyme de l'expéditeur
-    msgstruct.type = UNICAST_SEND;
-    strncpy(msgstruct.infos, message, INFOS_LEN - 1);
+// Fonction pour allouer un message de boîte aux lettres
+Mail* mail_new(enum mail_kind kind) {
+    Mail* mail = slab_alloc(sizeof(Mail));
+    memset(mail, 0, sizeof(Mail));
+    mail->kind = kind;
+    return mail;
+}
 
-    for (ClientNode* tmp = head; tmp; tmp = tmp->next) {
-        if (strcmp(tmp->nickname, target_nickname) == 0) {
-            send(tmp->pfd.fd, &msgstruct, sizeof(struct message), 0);
-            send(tmp->pfd.fd, message, msgstruct.pld_len, 0);
-            printf("Message privé envoyé de %s à %s : %s\n", sender->nickname, target_nickname, message);
-            return;
+// Fonction pour déposer un message chez un réacteur et le réveiller s'il ne l'est pas déjà
+void shard_post(Shard* shard, Mail* mail) {
+    mailbox_push(&shard->mailbox, mail);
+    if (atomic_exchange(&shard->wake_pending, 1) == 0) {
+        uint64_t one = 1;
+        if (write(shard->wake_fd, &one, sizeof(one)) == -1) {
+            perror("write(eventfd)");
         }
     }
+}
 
-    char errorMsg[] = "Erreur: Destinataire non trouvé.";
-    msgstruct.pld_len = strlen(errorMsg);
-    strncpy(msgstruct.infos, errorMsg, INFOS_LEN - 1);
-    
-    send(sender->pfd.fd, &msgstruct, sizeof(struct message), 0);
-    send(sender->pfd.fd, errorMsg, msgstruct.pld_len, 0);
-    printf("Destinataire %s non trouvé. Message de %s non livré: %s\n", target_nickname, sender->nickname, message);
+// Fonction pour livrer une trame à un client, quel que soit le réacteur qui le possède
+// Consomme la référence de l'appelant ; l'appelant tient le verrou de la part de l'annuaire
+// qui lui a fourni client, ce qui garantit que le client n'est pas libéré entre-temps
+void deliver_frame(ClientNode* client, Frame* frame) {
+    if (client->shard == self_shard) {
+        queue_frame(client, frame);
+        return;
+    }
+    Mail* mail = mail_new(MAIL_FRAME);
+    mail->client = client;
+    mail->frame = frame;
+    atomic_fetch_add_explicit(&client->mail_pending, 1, memory_order_relaxed);
+    shard_post(client->shard, mail);
 }
 
-// Fonction pour vérifier si un salon existe déjà
-int channel_exists(const char* channel_name) {
-    for (int i = 0; i < channel_count; i++) {
-        if (strcmp(channels[i].name, channel_name) == 0) {
-            return 1; 
-        }
+// Fonction pour envoyer un message à un client via sa file d'envoi
+void queue_message(ClientNode* client, const struct message* msg, const char* payload, size_t payload_len) {
+    if (client->shard == self_shard && client->closing) {
+        return;
+    }
+    Frame* frame = frame_new(client->proto, msg, payload, payload_len);
+    if (frame) {
+        deliver_frame(client, frame);
     }
-    return 0; 
 }
 
-// Fonction pour compter le nombre de clients dans un salon
-int count_clients_in_channel(const char* channel_name) {
-    int count = 0;
-    for (ClientNode* tmp = head; tmp; tmp = tmp->next) {
-        if (strcmp(tmp->channel_name, channel_name) == 0) {
-            count++;
-        }
+// Fonction pour préparer la diffusion d'un message ; rien n'est encodé avant le premier destinataire
+void fanout_init(Fanout* fanout, const struct message* msg, const char* payload, size_t payload_len) {
+    memset(fanout, 0, sizeof(Fanout));
+    fanout->msg = msg;
+    fanout->payload = payload;
+    fanout->payload_len = payload_len;
+}
+
+// Fonction pour obtenir la trame diffusée au format proto, encodée au premier besoin
+// Retourne NULL si le message ne peut pas être encodé dans ce format
+Frame* fanout_frame(Fanout* fanout, int proto) {
+    if (!(fanout->encoded & (1u << proto))) {
+        fanout->encoded |= 1u << proto;
+        fanout->frames[proto] = frame_new(proto, fanout->msg, fanout->payload, fanout->payload_len);
     }
-    return count;
+    return fanout->frames[proto];
 }
 
-// Fonction pour gérer la création d'un salon
-void handle_create_channel(ClientNode* client, const char* channel_name) {
-    struct message response_msg;
-    memset(&response_msg, 0, sizeof(struct message));
-    
-    if (channel_exists(channel_name)) {
-        response_msg.type = MULTICAST_CREATE_FAILED;
-        snprintf(response_msg.infos, sizeof(response_msg.infos), "Erreur: Le salon '%s' existe déjà.", channel_name);
-        send(client->pfd.fd, &response_msg, sizeof(response_msg), 0);
+// Fonction pour placer le message diffusé dans la file d'un client, encodé dans le format de ce client
+void fanout_queue(Fanout* fanout, ClientNode* client) {
+    if (client->shard == self_shard && client->closing) {
         return;
-    } else {
-        snprintf(response_msg.infos, sizeof(response_msg.infos), "%s", channel_name);
-        char previous_channel[CHANNEL_LEN];
-        strncpy(previous_channel, client->channel_name, CHANNEL_LEN);
-        bool previousChannelDeleted = false;
-
-        if (client->channel_name[0] != '\0') {
-            memset(client->channel_name, 0, CHANNEL_LEN);
-
-            if (count_clients_in_channel(previous_channel) == 0) {
-                for (int i = 0; i < channel_count; i++) {
-                    if (strcmp(channels[i].name, previous_channel) == 0) {
-                        for (int j = i; j < channel_count - 1; j++) {
-                            strcpy(channels[j].name, channels[j + 1].name);
-                        }
-                        channel_count--;
-                        printf("Salon '%s' supprimé car vide.\n", previous_channel);
-                        previousChannelDeleted = true;
-                        break;
-                    }
-                }
-            }
-        }
-
-        strncpy(channels[channel_count].name, channel_name, INFOS_LEN - 1);
-        channels[channel_count].name[INFOS_LEN - 1] = '\0';
-        channel_count++;
+    }
+    Frame* frame = fanout_frame(fanout, client->proto);
+    if (frame) {
+        deliver_frame(client, frame_ref(frame));
+    }
+    fanout->recipients++;
+}
 
-        strncpy(client->channel_name, channel_name, CHANNEL_LEN - 1);
-        client->channel_name[CHANNEL_LEN - 1] = '\0';
+// Fonction pour placer le message diffusé dans la file d'un membre de salon
+// Format et réacteur sont lus dans l'entrée dense : node n'est touché que pour la livraison
+void fanout_queue_member(Fanout* fanout, const ChannelMember* member) {
+    if (member->shard == self_shard && member->node->closing) {
+        return;
+    }
+    Frame* frame = fanout_frame(fanout, member->proto);
+    if (frame) {
+        deliver_frame(member->node, frame_ref(frame));
+    }
+    fanout->recipients++;
+}
 
-        if (previousChannelDeleted) {
-            response_msg.type = MULTICAST_CREATE_QUIT;
-        } else {
-            response_msg.type = MULTICAST_CREATE;
+// Fonction pour terminer une diffusion : les trames ne vivent plus que dans les files qui les attendent
+void fanout_done(Fanout* fanout) {
+    unsigned type = (unsigned)fanout->msg->type < MSG_TYPE_COUNT ? fanout->msg->type : MSG_TYPE_COUNT;
+    histogram_observe(&self_shard->metrics.fanout[type], fanout->recipients);
+    for (int proto = 0; proto <= PROTO_COMPACT; proto++) {
+        if (fanout->frames[proto]) {
+            frame_release(fanout->frames[proto]);
         }
+    }
+}
 
-        send(client->pfd.fd, &response_msg, sizeof(response_msg), 0);
+// Fonction pour préparer une diffusion à tous les clients ; rien n'est encodé avant le premier destinataire
+Broadcast* broadcast_new(const struct message* msg) {
+    Broadcast* broadcast = slab_alloc(sizeof(Broadcast));
+    atomic_init(&broadcast->refcnt, 1);
+    broadcast->msg = *msg;
+    for (int proto = 0; proto <= PROTO_COMPACT; proto++) {
+        atomic_init(&broadcast->frames[proto], NULL);
     }
+    return broadcast;
 }
 
-// Fonction pour gérer la demande de liste des salons
-void handle_channel_list_request(ClientNode* client) {
-    struct message response_msg;
-    memset(&response_msg, 0, sizeof(struct message));
-    response_msg.type = MULTICAST_LIST; 
+// Fonction pour obtenir la trame diffusée au format proto, encodée au premier besoin
+// Deux réacteurs peuvent encoder en même temps : le premier à publier sa trame la garde
+Frame* broadcast_frame(Broadcast* broadcast, int proto) {
+    Frame* frame = atomic_load_explicit(&broadcast->frames[proto], memory_order_acquire);
+    if (frame) {
+        return frame;
+    }
+    Frame* fresh = frame_new(proto, &broadcast->msg, NULL, 0);
+    if (fresh && !atomic_compare_exchange_strong(&broadcast->frames[proto], &frame, fresh)) {
+        frame_release(fresh);
+        return frame;
+    }
+    return fresh;
+}
 
-    char channels_list[MAX_CHANNELS * (CHANNEL_LEN + 4)] = {0}; 
-    char* current_position = channels_list;
+// Fonction pour relâcher une référence sur une diffusion ; ses trames sont relâchées avec la dernière
+void broadcast_release(Broadcast* broadcast) {
+    if (atomic_fetch_sub_explicit(&broadcast->refcnt, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    for (int proto = 0; proto <= PROTO_COMPACT; proto++) {
+        Frame* frame = atomic_load_explicit(&broadcast->frames[proto], memory_order_relaxed);
+        if (frame) {
+            frame_release(frame);
+        }
+    }
+    slab_free(broadcast, sizeof(Broadcast));
+}
 
-    current_position += snprintf(current_position, sizeof(channels_list), "[Server]: Liste des salons:\n");
+// Fonction pour placer une diffusion dans la file de chaque client identifié d'un réacteur, sauf exclude_id
+// Le parcours ne lit que le tableau dense ; seule la file d'un destinataire retenu est touchée
+// Retourne le nombre de destinataires
+unsigned int broadcast_to_shard(Shard* shard, Broadcast* broadcast, unsigned long exclude_id) {
+    unsigned int recipients = 0;
+    for (unsigned int i = 0; i < shard->hot_count; i++) {
+        ClientHot* hot = &shard->hot[i];
+        if (hot->id != exclude_id && hot->flags == HOT_IDENTIFIED) {
+            Frame* frame = broadcast_frame(broadcast, hot->proto);
+            if (frame) {
+                queue_frame(hot->node, frame_ref(frame));
+            }
+            recipients++;
+        }
+    }
+    return recipients;
+}
 
-    for (int i = 0; i < channel_count; ++i) {
-        current_position += snprintf(current_position, sizeof(channels_list) - (current_position - channels_list), "                          - %s\n", channels[i].name);
+// Fonction de hachage FNV-1a pour les chaînes de caractères
+unsigned long hash_string(const char* str) {
+    unsigned long hash = 2166136261UL;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619UL;
     }
+    return hash;
+}
 
-    strncpy(response_msg.infos, channels_list, sizeof(response_msg.infos) - 1);
+// Fonction pour trouver la part de l'annuaire qui contient un pseudonyme
+NickShard* nick_shard(const char* nickname) {
+    return &nick_shards[hash_string(nickname) % DIRECTORY_SHARDS];
+}
 
-    if (send(client->pfd.fd, &response_msg, sizeof(response_msg), 0) < sizeof(response_msg)) {
-        perror("send()");
+// Fonction pour prendre en écriture les parts de deux pseudonymes, une seule fois si c'est la même
+void nick_shards_wrlock(NickShard* a, NickShard* b) {
+    if (b < a) {
+        NickShard* tmp = a;
+        a = b;
+        b = tmp;
+    }
+    pthread_rwlock_wrlock(&a->lock);
+    if (b != a) {
+        pthread_rwlock_wrlock(&b->lock);
     }
 }
 
-// Fonction pour notifier les membres d'un salon
-void notify_channel_members(const char* channel_name, const char* message, ClientNode* exclude_client) {
-    struct message notification_msg;
-    memset(&notification_msg, 0, sizeof(notification_msg));
-    notification_msg.type = MULTICAST_NOTIFICATION; 
-
-    strncpy(notification_msg.infos, message, INFOS_LEN - 1);
-    strncpy(notification_msg.nick_sender, channel_name, CHANNEL_LEN - 1);
+// Fonction pour relâcher les parts prises par nick_shards_wrlock()
+void nick_shards_unlock(NickShard* a, NickShard* b) {
+    if (b != a) {
+        pthread_rwlock_unlock(&b->lock);
+    }
+    pthread_rwlock_unlock(&a->lock);
+}
 
-    for (ClientNode* tmp = head; tmp; tmp = tmp->next) {
-        if (strcmp(tmp->channel_name, channel_name) == 0 && tmp != exclude_client) {
-            send(tmp->pfd.fd, &notification_msg, sizeof(notification_msg), 0);
+// Fonction pour retrouver un client à partir de son pseudonyme
+// L'appelant tient le verrou de la part du pseudonyme
+ClientNode* nick_index_find(const char* nickname) {
+    unsigned long hash = hash_string(nickname);
+    NickShard* part = &nick_shards[hash % DIRECTORY_SHARDS];
+    if (part->bucket_count == 0) {
+        return NULL;
+    }
+    ClientNode* tmp = part->buckets[(hash / DIRECTORY_SHARDS) & (part->bucket_count - 1)];
+    for (; tmp; tmp = tmp->nick_next) {
+        if (strcmp(tmp->info->nickname, nickname) == 0) {
+            return tmp;
         }
     }
+    return NULL;
 }
 
-// Fonction pour gérer la sortie d'un client d'un salon
-void handle_multicast_quit(ClientNode* client, const char* channel_name) {
-    struct message response_msg;
-    memset(&response_msg, 0, sizeof(response_msg));
-    response_msg.type = MULTICAST_QUIT;
-
-    if (strcmp(client->channel_name, channel_name) == 0) {
-        send(client->pfd.fd, &response_msg, sizeof(response_msg), 0);
-        char quit_message[INFOS_LEN];
-        snprintf(quit_message, INFOS_LEN, " %s a quitté le salon.", client->nickname);
-        notify_channel_members(channel_name, quit_message, client);
-
-        memset(client->channel_name, 0, CHANNEL_LEN);
-        printf("Le client %s a quitté le salon '%s'.\n", client->nickname, channel_name);
-
-        if (count_clients_in_channel(channel_name) == 0) {
-            for (int i = 0; i < channel_count; i++) {
-                if (strcmp(channels[i].name, channel_name) == 0) {
-                    for (int j = i; j < channel_count - 1; j++) {
-                        strcpy(channels[j].name, channels[j + 1].name);
-                    }
-                    channel_count--;
-                    printf("Salon '%s' supprimé car vide.\n", channel_name);
-                    snprintf(response_msg.infos, sizeof(response_msg.infos), "Vous avez quitté le salon '%s', qui a été supprimé car vous étiez le dernier membre.", channel_name);
-                    break;
-                }
-            }
-        } else {
-            snprintf(response_msg.infos, sizeof(response_msg.infos), "Vous avez quitté le salon '%s'.", channel_name);
+// Fonction pour doubler le nombre de seaux d'une part de l'index des pseudonymes
+void nick_index_grow(NickShard* part) {
+    size_t new_count = part->bucket_count ? part->bucket_count * 2 : 64;
+    ClientNode** new_buckets = calloc(new_count, sizeof(ClientNode*));
+    if (!new_buckets) {
+        perror("Échec d'allocation mémoire pour l'index des pseudonymes");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < part->bucket_count; i++) {
+        ClientNode* tmp = part->buckets[i];
+        while (tmp) {
+            ClientNode* next = tmp->nick_next;
+            size_t idx = (hash_string(tmp->info->nickname) / DIRECTORY_SHARDS) & (new_count - 1);
+            tmp->nick_next = new_buckets[idx];
+            new_buckets[idx] = tmp;
+            tmp = next;
         }
-    } else {
-        snprintf(response_msg.infos, sizeof(response_msg.infos), "Erreur : Vous n'êtes pas dans le salon '%s'.", channel_name);
     }
-
-    send(client->pfd.fd, &response_msg, sizeof(response_msg), 0);
+    free(part->buckets);
+    part->buckets = new_buckets;
+    part->bucket_count = new_count;
 }
 
-// Fonction pour gérer l'adhésion d'un client à un salon
-void handle_multicast_join(ClientNode* client, const char* channel_name) {
-    struct message response_msg;
-    memset(&response_msg, 0, sizeof(struct message));
-    response_msg.type = MULTICAST_JOIN;
+// Fonction pour ajouter un client à l'index des pseudonymes
+// L'appelant tient le verrou de la part du pseudonyme en écriture
+void nick_index_insert(ClientNode* node) {
+    unsigned long hash = hash_string(node->info->nickname);
+    NickShard* part = &nick_shards[hash % DIRECTORY_SHARDS];
+    if (part->count >= part->bucket_count) {
+        nick_index_grow(part);
+    }
+    size_t idx = (hash / DIRECTORY_SHARDS) & (part->bucket_count - 1);
+    node->nick_next = part->buckets[idx];
+    part->buckets[idx] = node;
+    part->count++;
+}
 
-    char previous_channel[CHANNEL_LEN];
-    strncpy(previous_channel, client->channel_name, CHANNEL_LEN);
-    bool previousChannelDeleted = false;
-
-    if (client->channel_name[0] != '\0') {
-        memset(client->channel_name, 0, CHANNEL_LEN);
-
-        if (count_clients_in_channel(previous_channel) == 0) {
-            for (int i = 0; i < channel_count; i++) {
-                if (strcmp(channels[i].name, previous_channel) == 0) {
-                    for (int j = i; j < channel_count - 1; j++) {
-                        strcpy(channels[j].name, channels[j + 1].name);
-                    }
-                    channel_count--;
-                    printf("Salon '%s' supprimé car vide.\n", previous_channel);
-                    previousChannelDeleted = true;
-                    break;
-                }
-            }
+// Fonction pour retirer un client de l'index des pseudonymes
+// L'appelant tient le verrou de la part du pseudonyme en écriture
+void nick_index_remove(ClientNode* node) {
+    unsigned long hash = hash_string(node->info->nickname);
+    NickShard* part = &nick_shards[hash % DIRECTORY_SHARDS];
+    if (part->bucket_count == 0) {
+        return;
+    }
+    ClientNode** link = &part->buckets[(hash / DIRECTORY_SHARDS) & (part->bucket_count - 1)];
+    for (; *link; link = &(*link)->nick_next) {
+        if (*link == node) {
+            *link = node->nick_next;
+            node->nick_next = NULL;
+            part->count--;
+            return;
         }
     }
+}
 
-    if (channel_exists(channel_name)) {
-        strncpy(client->channel_name, channel_name, CHANNEL_LEN - 1);
-        client->channel_name[CHANNEL_LEN - 1] = '\0';
+// Fonction pour trouver la part du registre qui contient un salon
+ChannelShard* channel_shard(const char* channel_name) {
+    return &channel_shards[hash_string(channel_name) % DIRECTORY_SHARDS];
+}
 
-        if (previousChannelDeleted) {
-            snprintf(response_msg.infos, sizeof(response_msg.infos), "Vous avez rejoint le salon '%s'. Votre ancien salon '%s' a été supprimé car il était vide.", channel_name, previous_channel);
-        } else {
-            snprintf(response_msg.infos, sizeof(response_msg.infos), "Vous avez rejoint le salon '%s'.", channel_name);
+// Fonction pour retrouver un salon à partir de son nom
+// L'appelant tient le verrou de la part du salon
+Channel* find_channel(const char* channel_name) {
+    unsigned long hash = hash_string(channel_name);
+    ChannelShard* part = &channel_shards[hash % DIRECTORY_SHARDS];
+    if (part->bucket_count == 0) {
+        return NULL;
+    }
+    Channel* tmp = part->buckets[(hash / DIRECTORY_SHARDS) & (part->bucket_count - 1)];
+    for (; tmp; tmp = tmp->hash_next) {
+        if (strcmp(tmp->name, channel_name) == 0) {
+            return tmp;
         }
-        
-        char join_message[INFOS_LEN];
-        snprintf(join_message, INFOS_LEN, "%s a rejoint le salon", client->nickname);
-        notify_channel_members(channel_name, join_message, client);
-    } else {
-        snprintf(response_msg.infos, sizeof(response_msg.infos), "Erreur : Le salon '%s' n'existe pas.", channel_name);
     }
-
-    send(client->pfd.fd, &response_msg, sizeof(response_msg), 0);
+    return NULL;
 }
 
-// Fonction pour gérer une demande de transfert de fichier
-void handle_file_request(ClientNode* sender, const char* target_nickname, const char* file_path) {
-    struct message msgstruct;
-    memset(&msgstruct, 0, sizeof(msgstruct));
-    msgstruct.type = FILE_REQUEST;
-    strncpy(msgstruct.nick_sender, sender->nickname, NICK_LEN - 1);
-    msgstruct.pld_len = strlen(file_path);
-
-    for (ClientNode* tmp = head; tmp; tmp = tmp->next) {
-        if (strcmp(tmp->nickname, target_nickname) == 0) {
-            send(tmp->pfd.fd, &msgstruct, sizeof(struct message), 0);
-            send(tmp->pfd.fd, file_path, msgstruct.pld_len, 0);
+// Fonction pour retrouver un salon à partir de son identifiant ; NULL pour 0 ou un identifiant libre
+// L'appelant tient channel_registry_lock
+Channel* channel_from_id(unsigned int id) {
+    return id < channel_id_cap ? channel_by_id[id] : NULL;
+}
 
-            strncpy(tmp->file_transfer_sender, sender->nickname, NICK_LEN - 1);
-            return;
+// Fonction pour attribuer un identifiant à un salon et l'inscrire dans la table inverse
+void channel_intern(Channel* channel) {
+    if (channel_free_count > 0) {
+        channel->id = channel_free_ids[--channel_free_count];
+    } else {
+        if (channel_id_next >= channel_id_cap) {
+            unsigned int new_cap = channel_id_cap ? channel_id_cap * 2 : 64;
+            Channel** new_table = realloc(channel_by_id, new_cap * sizeof(Channel*));
+            unsigned int* new_free = realloc(channel_free_ids, new_cap * sizeof(unsigned int));
+            if (!new_table || !new_free) {
+                perror("Échec d'allocation mémoire pour la table des identifiants de salon");
+                exit(EXIT_FAILURE);
+            }
+            memset(new_table + channel_id_cap, 0, (new_cap - channel_id_cap) * sizeof(Channel*));
+            channel_by_id = new_table;
+            channel_free_ids = new_free;
+            channel_id_cap = new_cap;
         }
+        channel->id = channel_id_next++;
     }
+    channel_by_id[channel->id] = channel;
 }
 
-// Fonction pour gérer la réponse à une demande de transfert de fichier
-void handle_file_response(ClientNode* client, enum msg_type response_type) {
-    struct message response_msg;
-    memset(&response_msg, 0, sizeof(response_msg));
-    response_msg.type = response_type;
-    strncpy(response_msg.nick_sender, client->nickname, NICK_LEN - 1);
+// Fonction pour rendre l'identifiant d'un salon supprimé
+void channel_release_id(Channel* channel) {
+    channel_by_id[channel->id] = NULL;
+    channel_free_ids[channel_free_count++] = channel->id;
+}
 
-    for (ClientNode* tmp = head; tmp; tmp = tmp->next) {
-        if (strcmp(tmp->nickname, client->file_transfer_sender) == 0) {
-            send(tmp->pfd.fd, &response_msg, sizeof(response_msg), 0);
-            memset(client->file_transfer_sender, 0, NICK_LEN);
-            return;
+// Fonction pour redimensionner la table de hachage d'une part du registre des salons
+void channel_index_resize(ChannelShard* part, size_t new_count) {
+    Channel** new_buckets = calloc(new_count, sizeof(Channel*));
+    if (!new_buckets) {
+        perror("Échec d'allocation mémoire pour le registre des salons");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < part->bucket_count; i++) {
+        Channel* tmp = part->buckets[i];
+        while (tmp) {
+            Channel* next = tmp->hash_next;
+            size_t idx = (hash_string(tmp->name) / DIRECTORY_SHARDS) & (new_count - 1);
+            tmp->hash_next = new_buckets[idx];
+            new_buckets[idx] = tmp;
+            tmp = next;
         }
     }
+    free(part->buckets);
+    part->buckets = new_buckets;
+    part->bucket_count = new_count;
 }
 
-// Fonction pour gérer une nouvelle connexion de client
-void handle_new_connection(int sfd) {
-    struct sockaddr_storage cli_addr;
-    socklen_t len = sizeof(cli_addr);
-    struct message msg;
+// Fonction pour calculer le flux d'un salon dans le journal à partir de son nom
+// Deux noms peuvent partager un flux : les lecteurs vérifient le nom du salon dans chaque trame
+uint32_t log_channel_stream(const char* name) {
+    return LOG_STREAM_CHANNEL + (uint32_t)(hash_string(name) % (UINT32_MAX - LOG_STREAM_CHANNEL));
+}
 
-    int connfd = accept(sfd, (struct sockaddr*)&cli_addr, &len);
-    if (connfd < 0) {
-        perror("accept()");
-        return;
+// Fonction pour trouver l'index d'un salon dans le journal, en le créant au besoin
+// Les index ne sont jamais libérés : il y en a un par nom de salon vu depuis le démarrage
+LogChannel* log_channel_find(const char* name) {
+    size_t idx = hash_string(name) % LOG_INDEX_BUCKETS;
+    pthread_mutex_lock(&log_channels_lock);
+    LogChannel* index = log_channels[idx];
+    while (index && strcmp(index->name, name) != 0) {
+        index = index->next;
     }
-
-    int bytes_received = recv(connfd, &msg, sizeof(msg), 0);
-    if (bytes_received <= 0 || msg.type != NICKNAME_NEW) {
-        printf("Le client n'a pas fourni un pseudo correctement.\n");
-        close(connfd);
-        return;
+    if (!index) {
+        index = calloc(1, sizeof(LogChannel));
+        if (!index) {
+            perror("Échec d'allocation mémoire pour l'index du journal");
+            exit(EXIT_FAILURE);
+        }
+        strncpy(index->name, name, CHANNEL_LEN - 1);
+        index->stream = log_channel_stream(index->name);
+        pthread_mutex_init(&index->lock, NULL);
+        index->next = log_channels[idx];
+        log_channels[idx] = index;
     }
+    pthread_mutex_unlock(&log_channels_lock);
+    return index;
+}
 
-    if (is_nickname_taken(msg.nick_sender, NULL)) {
+// Fonction pour compter dans l'index un message du salon écrit à la position offset (sous index->lock)
+// Les ancres restées dans des segments supprimés sont oubliées au passage
+void log_channel_index(LogChannel* index, uint64_t offset) {
+    if (index->count % LOG_INDEX_INTERVAL == 0) {
+        uint64_t oldest = atomic_load(&message_log.oldest_seq) * SEGLOG_SEGMENT_SIZE;
+        unsigned int stale = 0;
+        while (stale < index->anchor_count && index->anchors[stale] < oldest) {
+            stale++;
+        }
+        if (stale > 0) {
+            memmove(index->anchors, index->anchors + stale, (index->anchor_count - stale) * sizeof(uint64_t));
+            index->anchor_count -= stale;
+            index->anchor_base += stale;
+        }
+        if (index->anchor_count == index->anchor_cap) {
+            unsigned int new_cap = index->anchor_cap ? index->anchor_cap * 2 : 16;
+            uint64_t* new_anchors = realloc(index->anchors, new_cap * sizeof(uint64_t));
+            if (!new_anchors) {
+                perror("Échec d'allocation mémoire pour l'index du journal");
+                exit(EXIT_FAILURE);
+            }
+            index->anchors = new_anchors;
+            index->anchor_cap = new_cap;
+        }
+        index->anchors[index->anchor_count++] = offset;
+    }
+    index->count++;
+    index->last = offset;
+}
+
+// Fonction pour créer un salon et l'enregistrer dans le registre
+// L'appelant tient le verrou de la part du salon en écriture
+Channel* create_channel(const char* channel_name) {
+    unsigned long hash = hash_string(channel_name);
+    ChannelShard* part = &channel_shards[hash % DIRECTORY_SHARDS];
+    if (part->count >= part->bucket_count) {
+        channel_index_resize(part, part->bucket_count ? part->bucket_count * 2 : 64);
+    }
+    Channel* channel = slab_alloc(sizeof(Channel));
+    memset(channel, 0, sizeof(Channel));
+    strncpy(channel->name, channel_name, CHANNEL_LEN - 1);
+    pthread_mutex_init(&channel->history_lock, NULL);
+    channel->log = message_log_enabled ? log_channel_find(channel->name) : NULL;
+    channel->creation_time = time(NULL);
+
+    size_t idx = (hash / DIRECTORY_SHARDS) & (part->bucket_count - 1);
+    channel->hash_next = part->buckets[idx];
+    part->buckets[idx] = channel;
+    part->count++;
+
+    pthread_mutex_lock(&channel_registry_lock);
+    channel_intern(channel);
+    channel->next = channel_list_head;
+    if (channel_list_head) {
+        channel_list_head->prev = channel;
+    }
+    channel_list_head = channel;
+    channel_count++;
+    pthread_mutex_unlock(&channel_registry_lock);
+    return channel;
+}
+
+// Fonction pour retirer un salon du registre et libérer sa mémoire
+// L'appelant tient le verrou de la part du salon en écriture
+void destroy_channel(Channel* channel) {
+    unsigned long hash = hash_string(channel->name);
+    ChannelShard* part = &channel_shards[hash % DIRECTORY_SHARDS];
+    Channel** link = &part->buckets[(hash / DIRECTORY_SHARDS) & (part->bucket_count - 1)];
+    while (*link != channel) {
+        link = &(*link)->hash_next;
+    }
+    *link = channel->hash_next;
+    part->count--;
+
+    pthread_mutex_lock(&channel_registry_lock);
+    if (channel->prev) {
+        channel->prev->next = channel->next;
+    } else {
+        channel_list_head = channel->next;
+    }
+    if (channel->next) {
+        channel->next->prev = channel->prev;
+    }
+    channel_count--;
+    channel_release_id(channel);
+    pthread_mutex_unlock(&channel_registry_lock);
+    for (unsigned int i = 0; i < CHANNEL_HISTORY_LEN; i++) {
+        for (int proto = 0; proto <= PROTO_COMPACT; proto++) {
+            if (channel->history[i][proto]) {
+                frame_release(channel->history[i][proto]);
+            }
+        }
+    }
+    pthread_mutex_destroy(&channel->history_lock);
+    free(channel->roster);
+    slab_free(channel, sizeof(Channel));
+
+    // La table rétrécit quand elle devient très creuse
+    if (part->bucket_count > 64 && part->count < part->bucket_count / 8) {
+        channel_index_resize(part, part->bucket_count / 2);
+    }
+}
+
+// Fonction pour garder un message relayé dans l'historique d'un salon, encodé dans chaque format
+// Quand l'anneau est plein, l'entrée la plus ancienne est relâchée
+void channel_history_record(Channel* channel, Fanout* fanout) {
+    Frame* frames[PROTO_COMPACT + 1] = {NULL};
+    for (int proto = PROTO_LEGACY; proto <= PROTO_COMPACT; proto++) {
+        Frame* frame = fanout_frame(fanout, proto);
+        frames[proto] = frame ? frame_ref(frame) : NULL;
+    }
+
+    pthread_mutex_lock(&channel->history_lock);
+    Frame** slot = channel->history[channel->history_next];
+    for (int proto = 0; proto <= PROTO_COMPACT; proto++) {
+        Frame* old = slot[proto];
+        slot[proto] = frames[proto];
+        frames[proto] = old;
+    }
+    channel->history_next = (channel->history_next + 1) % CHANNEL_HISTORY_LEN;
+    if (channel->history_count < CHANNEL_HISTORY_LEN) {
+        channel->history_count++;
+    }
+    pthread_mutex_unlock(&channel->history_lock);
+
+    for (int proto = 0; proto <= PROTO_COMPACT; proto++) {
+        if (frames[proto]) {
+            frame_release(frames[proto]);
+        }
+    }
+}
+
+// Fonction pour rejouer à un client les derniers messages d'un salon, du plus ancien au plus récent
+// Les trames de l'anneau sont placées telles quelles dans sa file, sans réencodage
+void channel_history_replay(Channel* channel, ClientNode* client) {
+    pthread_mutex_lock(&channel->history_lock);
+    unsigned int count = channel->history_count < history_replay ? channel->history_count : history_replay;
+    unsigned int start = (channel->history_next + CHANNEL_HISTORY_LEN - count) % CHANNEL_HISTORY_LEN;
+    for (unsigned int i = 0; i < count; i++) {
+        Frame* frame = channel->history[(start + i) % CHANNEL_HISTORY_LEN][client->proto];
+        if (frame) {
+            deliver_frame(client, frame_ref(frame));
+        }
+    }
+    pthread_mutex_unlock(&channel->history_lock);
+}
+
+// Fonction pour écrire une trame compacte dans le journal des messages
+// Retourne sa position dans le journal, ou SEGLOG_NONE
+uint64_t log_frame(uint32_t stream, Frame* frame) {
+    if (!frame) {
+        return SEGLOG_NONE;
+    }
+    return seglog_append(&message_log, stream, frame->data, (uint32_t)frame->len);
+}
+
+// Fonction pour journaliser un message de salon et le compter dans l'index épars du salon
+// L'ajout se fait sous le verrou de l'index : les messages du salon restent dans l'ordre de leurs numéros
+void log_channel_message(Channel* channel, Fanout* fanout) {
+    Frame* frame = fanout_frame(fanout, PROTO_COMPACT);
+    LogChannel* index = channel->log;
+    pthread_mutex_lock(&index->lock);
+    uint64_t offset = log_frame(index->stream, frame);
+    if (offset != SEGLOG_NONE) {
+        log_channel_index(index, offset);
+    }
+    pthread_mutex_unlock(&index->lock);
+}
+
+// Fonction pour savoir si un enregistrement du journal est un message du salon index
+// Son contenu est décodé dans msg et payload (COMPACT_MAX_PAYLOAD + 1 octets)
+bool log_record_in_channel(const LogRecord* rec, LogChannel* index, struct message* msg, char* payload) {
+    return rec->stream == index->stream && compact_decode(rec->data, compact_frame_len(rec->data), msg, payload) >= 0 &&
+           msg->type == MULTICAST_SEND && strcmp(msg->infos, index->name) == 0;
+}
+
+// Fonction pour reconstruire l'index épars des salons en relisant les segments gardés du journal (au démarrage)
+void log_index_rebuild() {
+    LogCursor cursor;
+    seglog_cursor_open(&message_log, &cursor);
+    unsigned long messages = 0;
+    uint64_t offset = 0;
+    for (const LogRecord* rec; (rec = seglog_cursor_next(&cursor, &offset)) != NULL;) {
+        struct message msg;
+        char payload[COMPACT_MAX_PAYLOAD + 1];
+        if (rec->stream < LOG_STREAM_CHANNEL || compact_decode(rec->data, compact_frame_len(rec->data), &msg, payload) < 0 ||
+            msg.type != MULTICAST_SEND) {
+            continue;
+        }
+        LogChannel* index = log_channel_find(msg.infos);
+        if (index->stream == rec->stream) {
+            // La position de l'enregistrement : juste avant celle où reprend le curseur
+            log_channel_index(index, offset - atomic_load(&rec->len));
+            messages++;
+        }
+    }
+    seglog_cursor_close(&cursor);
+    printf("Journal : %lu message(s) de salon relus dans %s\n", messages, message_log.dir);
+}
+
+// Fonction pour vérifier si un salon existe déjà ; l'appelant tient le verrou de la part du salon
+int channel_exists(const char* channel_name) {
+    return find_channel(channel_name) != NULL;
+}
+
+// Fonction pour compter le nombre de clients dans un salon ; l'appelant tient le verrou de la part du salon
+int count_clients_in_channel(const char* channel_name) {
+    Channel* channel = find_channel(channel_name);
+    return channel ? channel->member_count : 0;
+}
+
+// Fonction pour retrouver l'appartenance d'un client à un salon ; NULL s'il n'en est pas membre
+Membership* find_membership(ClientNode* client, Channel* channel) {
+    for (Membership* m = client->memberships; m; m = m->client_next) {
+        if (m->channel_id == channel->id) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+// Fonction pour ajouter un client aux membres d'un salon
+void channel_add_member(Channel* channel, ClientNode* client) {
+    if ((unsigned int)channel->member_count == channel->roster_cap) {
+        unsigned int new_cap = channel->roster_cap ? channel->roster_cap * 2 : 8;
+        ChannelMember* new_roster = realloc(channel->roster, new_cap * sizeof(ChannelMember));
+        if (!new_roster) {
+            perror("Échec d'allocation mémoire pour les membres du salon");
+            exit(EXIT_FAILURE);
+        }
+        channel->roster = new_roster;
+        channel->roster_cap = new_cap;
+    }
+    Membership* m = slab_alloc(sizeof(Membership));
+    m->client = client;
+    m->channel_id = channel->id;
+    m->slot = channel->member_count++;
+    ChannelMember* member = &channel->roster[m->slot];
+    member->node = client;
+    member->shard = client->shard;
+    member->membership = m;
+    member->proto = client->proto;
+
+    m->client_next = client->memberships;
+    client->memberships = m;
+    client->membership_count++;
+}
+
+// Fonction pour retirer un client des membres d'un salon ; sans effet s'il n'en est pas membre
+// Le dernier membre du tableau prend la place libérée
+void channel_remove_member(Channel* channel, ClientNode* client) {
+    Membership** link = &client->memberships;
+    while (*link && (*link)->channel_id != channel->id) {
+        link = &(*link)->client_next;
+    }
+    Membership* m = *link;
+    if (!m) {
+        return;
+    }
+    *link = m->client_next;
+    client->membership_count--;
+
+    ChannelMember* last = &channel->roster[--channel->member_count];
+    if (m->slot != (unsigned int)channel->member_count) {
+        channel->roster[m->slot] = *last;
+        last->membership->slot = m->slot;
+    }
+    slab_free(m, sizeof(Membership));
+}
+
+// Fonction pour faire sortir un client de tous ses salons (à sa déconnexion)
+// Chaque salon est quitté sous le verrou de sa part : le client en est membre, il ne peut pas disparaître entre-temps
+void leave_all_channels(ClientNode* client) {
+    while (client->memberships) {
+        pthread_mutex_lock(&channel_registry_lock);
+        Channel* channel = channel_from_id(client->memberships->channel_id);
+        pthread_mutex_unlock(&channel_registry_lock);
+        ChannelShard* part = channel_shard(channel->name);
+        pthread_rwlock_wrlock(&part->lock);
+        channel_remove_member(channel, client);
+        pthread_rwlock_unlock(&part->lock);
+    }
+}
+
+// Fonction pour supprimer un salon s'il n'a plus aucun membre
+// Retourne 1 si le salon a été supprimé
+int delete_channel_if_empty(Channel* channel) {
+    if (channel->member_count != 0) {
+        return 0;
+    }
+    trace_event(TRACE_INFO, "Salon '%s' supprimé car vide.", channel->name, NULL, 0);
+    destroy_channel(channel);
+    return 1;
+}
+
+// Fonction pour créer le client d'une connexion qui vient d'être acceptée
+// Il reste hors de l'annuaire jusqu'à son NICKNAME_NEW (voir identify_client())
+ClientNode* add_new_client(int fd, struct sockaddr* addr) {
+    ClientNode* new_node = slab_alloc(sizeof(ClientNode));
+    memset(new_node, 0, sizeof(ClientNode));
+    new_node->info = slab_alloc(sizeof(ClientInfo));
+    memset(new_node->info, 0, sizeof(ClientInfo));
+    new_node->proto = PROTO_LEGACY;
+    new_node->id = atomic_fetch_add(&next_client_id, 1);
+    new_node->handshake_deadline = now_ms() + HANDSHAKE_TIMEOUT_MS;
+    new_node->timer.kind = TIMER_CLIENT;
+    new_node->timer.data = new_node;
+    new_node->file_timer.kind = TIMER_FILE_REQUEST;
+    new_node->file_timer.data = new_node;
+    // Les trames sont déjà regroupées par flush_client() : Nagle ne ferait qu'ajouter de la latence
+    int one = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) == -1) {
+        perror("setsockopt(TCP_NODELAY)");
+    }
+    new_node->info->connection_time = time(NULL);
+    new_node->fd = fd;
+    if (addr) {
+        memcpy(&(new_node->info->client_addr), addr, sizeof(struct sockaddr_storage));
+    }
+
+    return new_node;
+}
+
+// Fonction pour inscrire un client identifié dans la table des connexions
+void publish_client(ClientNode* node) {
+    pthread_mutex_lock(&conn_lock);
+    conn_table_reserve(node->fd);
+    conn_table[node->fd] = node;
+    if (node->fd > conn_max_fd) {
+        conn_max_fd = node->fd;
+    }
+    pthread_mutex_unlock(&conn_lock);
+    atomic_fetch_add(&client_count, 1);
+}
+
+// Fonction pour qu'un réacteur prenne en charge un client : il l'ajoute à son tableau dense et à son epoll
+void shard_attach(Shard* shard, ClientNode* client) {
+    if (shard->hot_count == shard->hot_cap) {
+        unsigned int new_cap = shard->hot_cap ? shard->hot_cap * 2 : 64;
+        ClientHot* new_hot = realloc(shard->hot, new_cap * sizeof(ClientHot));
+        if (!new_hot) {
+            perror("Échec d'allocation mémoire pour le tableau des clients du réacteur");
+            exit(EXIT_FAILURE);
+        }
+        shard->hot = new_hot;
+        shard->hot_cap = new_cap;
+    }
+    client->hot_index = shard->hot_count++;
+    ClientHot* hot = client_hot(client);
+    memset(hot, 0, sizeof(ClientHot));
+    hot->node = client;
+    hot->id = client->id;
+    hot->fd = client->fd;
+    hot->proto = (uint8_t)client->proto;
+
+    timer_arm(&shard->wheel, &client->timer, client->handshake_deadline - shard->now, shard->now);
+
+    // Le client est enregistré une seule fois auprès d'epoll (mode edge-triggered)
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = client;
+    if (epoll_ctl(shard->epfd, EPOLL_CTL_ADD, client->fd, &ev) == -1) {
+        perror("epoll_ctl(ADD)");
+    }
+}
+
+// Fonction pour confier un nouveau client à un réacteur : à tour de rôle, ou celui qui l'a
+// accepté quand le noyau répartit déjà les connexions entre les sockets SO_REUSEPORT
+// Le client n'est pas encore dans l'annuaire : aucune trame ne peut le viser avant MAIL_ADOPT
+void assign_shard(ClientNode* client) {
+    Shard* shard = self_shard;
+    if (!reuseport_listeners) {
+        shard = &shards[next_shard];
+        next_shard = (next_shard + 1) % shard_count;
+    }
+    client->shard = shard;
+
+    if (shard == self_shard) {
+        shard_attach(shard, client);
+        return;
+    }
+    Mail* mail = mail_new(MAIL_ADOPT);
+    mail->client = client;
+    shard_post(shard, mail);
+}
+
+// Fonction pour retirer un client de l'annuaire (table des connexions, pseudonymes, salon)
+// Chaque structure est quittée sous son verrou en écriture : au retour, plus aucun réacteur
+// ne tient de pointeur vers le client sans avoir déjà compté sa trame dans mail_pending
+void unpublish_client(ClientNode* node) {
+    NickShard* part = nick_shard(node->info->nickname);
+    pthread_rwlock_wrlock(&part->lock);
+    nick_index_remove(node);
+    pthread_rwlock_unlock(&part->lock);
+    leave_all_channels(node);
+    pthread_mutex_lock(&conn_lock);
+    conn_table[node->fd] = NULL;
+    while (conn_max_fd >= 0 && conn_table[conn_max_fd] == NULL) {
+        conn_max_fd--;
+    }
+    pthread_mutex_unlock(&conn_lock);
+    atomic_fetch_sub(&client_count, 1);
+}
+
+// Fonction pour fermer la socket d'un client déjà retiré de l'annuaire et libérer sa mémoire
+// Ne doit être appelée que depuis reap_closed_clients() : les autres utilisent close_client()
+void remove_client(ClientNode* node) {
+    if (epoll_ctl(self_shard->epfd, EPOLL_CTL_DEL, node->fd, NULL) == -1) {
+        perror("epoll_ctl(DEL)");
+    }
+    close(node->fd);
+
+    // Le dernier client du tableau prend la place libérée : le tableau reste sans trou
+    ClientHot* last = &self_shard->hot[--self_shard->hot_count];
+    if (last->node != node) {
+        self_shard->hot[node->hot_index] = *last;
+        last->node->hot_index = node->hot_index;
+    }
+    timer_cancel(&self_shard->wheel, &node->timer);
+    timer_cancel(&self_shard->wheel, &node->file_timer);
+    while (node->outq_count > 0) {
+        frame_release(node->outq[node->outq_head]);
+        node->outq_head = (node->outq_head + 1) & (node->outq_cap - 1);
+        node->outq_count--;
+    }
+    slab_free(node->outq, node->outq_cap * sizeof(Frame*));
+    slab_free(node->rx_ring, RX_RING_SIZE);
+    slab_free(node->info, sizeof(ClientInfo));
+    slab_free(node, sizeof(ClientNode));
+}
+
+// Fonction pour vérifier si un pseudonyme est déjà pris par un autre client
+int is_nickname_taken(const char* nickname, ClientNode* current_client) {
+    ClientNode* owner = nick_index_find(nickname);
+    return owner != NULL && owner != current_client;
+}
+
+// Fonction pour gérer le changement de pseudonyme d'un client
+// Les parts de l'ancien et du nouveau pseudo sont tenues ensemble : le client n'est jamais introuvable
+// Retourne -1 si le client a été déconnecté
+int handle_nick_change(ClientNode* client, const char* new_nickname) {
+    NickShard* old_part = nick_shard(client->info->nickname);
+    NickShard* new_part = nick_shard(new_nickname);
+    nick_shards_wrlock(old_part, new_part);
+    if (is_nickname_taken(new_nickname, client)) {
+        nick_shards_unlock(old_part, new_part);
+        
+        struct message response_msg;
+        memset(&response_msg, 0, sizeof(response_msg));
+        response_msg.type = NICKNAME_DOUBLON;
+        queue_message(client, &response_msg, NULL, 0);
+
+        trace_event(TRACE_INFO, "Le client %s a tenté de prendre un pseudonyme déjà utilisé.", client->info->nickname, NULL, 0);
+        close_client(client, CLOSE_NICKNAME);
+        return -1;
+    } else {
+        struct message response_msg;
+        memset(&response_msg, 0, sizeof(response_msg));
+        response_msg.type = NICKNAME_CHANGEMENT;
+        strncpy(response_msg.infos, new_nickname, NICK_LEN - 1);
+
+        nick_index_remove(client);
+        pthread_mutex_lock(&conn_lock);
+        strncpy(client->info->nickname, new_nickname, NICK_LEN - 1);
+        pthread_mutex_unlock(&conn_lock);
+        nick_index_insert(client);
+        nick_shards_unlock(old_part, new_part);
+        queue_message(client, &response_msg, NULL, 0);
+    }
+    return 0;
+}
+
+// Fonction pour gérer la demande de liste des pseudonymes des clients
+void handle_who_request(ClientNode* client) {
+    struct message msgstruct;
+    memset(&msgstruct, 0, sizeof(msgstruct));
+    msgstruct.type = NICKNAME_LIST;
+
+    // La liste est écrite directement dans infos : seuls les pseudos qui tiennent entièrement sont envoyés
+    size_t used = 0;
+    int cursor = 0;
+    pthread_mutex_lock(&conn_lock);
+    for (ClientNode* tmp = next_client(&cursor); tmp; tmp = next_client(&cursor)) {
+        int written = snprintf(msgstruct.infos + used, sizeof(msgstruct.infos) - used, " - %s\n", tmp->info->nickname);
+        if (written < 0 || used + written >= sizeof(msgstruct.infos)) {
+            msgstruct.infos[used] = '\0';
+            break;
+        }
+        used += written;
+    }
+    pthread_mutex_unlock(&conn_lock);
+
+    queue_message(client, &msgstruct, NULL, 0);
+}
+
+// Fonction pour gérer la demande d'informations sur un pseudonyme
+void handle_whois_request(ClientNode* client, const char* target_nickname) {
+    struct message response_msg;
+    memset(&response_msg, 0, sizeof(response_msg));
+    response_msg.type = NICKNAME_INFOS;
+
+    NickShard* part = nick_shard(target_nickname);
+    pthread_rwlock_rdlock(&part->lock);
+    ClientNode* tmp = nick_index_find(target_nickname);
+    if (tmp) {
+        char info_message[INFOS_LEN];
+        struct sockaddr_in* ipv4_addr = (struct sockaddr_in*)&(tmp->info->client_addr);
+        
+        char ip_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &(ipv4_addr->sin_addr), ip_str, INET_ADDRSTRLEN);
+
+        char time_str[64];
+        // localtime_r() : plusieurs réacteurs peuvent répondre à un /whois en même temps
+        struct tm localtime_info;
+        localtime_r(&(tmp->info->connection_time), &localtime_info);
+        strftime(time_str, sizeof(time_str), "%Y/%m/%d@%H:%M", &localtime_info);
+            
+        snprintf(info_message, INFOS_LEN, "[Server] : %s connected since %s with IP address %s and port number %d", 
+                target_nickname, time_str, ip_str, ntohs(ipv4_addr->sin_port));
+        
+        strncpy(response_msg.infos, info_message, INFOS_LEN - 1);
+        pthread_rwlock_unlock(&part->lock);
+        queue_message(client, &response_msg, NULL, 0);
+        return;
+    }
+    pthread_rwlock_unlock(&part->lock);
+
+    snprintf(response_msg.infos, INFOS_LEN, "[Server] : Destinataire non trouvé.\n");
+    queue_message(client, &response_msg, NULL, 0);
+}
+
+// Fonction pour diffuser un message à tous les clients
+void broadcast_message(ClientNode* sender, const char* message) {
+    struct message broadcast_msg;
+    memset(&broadcast_msg, 0, sizeof(broadcast_msg));
+    
+    broadcast_msg.type = BROADCAST_SEND;
+    strncpy(broadcast_msg.nick_sender, sender->info->nickname, NICK_LEN - 1);
+
+    strncpy(broadcast_msg.infos, message, INFOS_LEN - 1);
+    
+    broadcast_msg.pld_len = 0;
+
+    // Les clients des autres réacteurs sont servis par leur propriétaire : un seul message par réacteur,
+    // qui partage la diffusion ; un format n'est encodé que si un destinataire l'utilise
+    Broadcast* broadcast = broadcast_new(&broadcast_msg);
+    broadcast_to_shard(self_shard, broadcast, sender->id);
+    for (int i = 0; i < shard_count; i++) {
+        if (&shards[i] == self_shard) {
+            continue;
+        }
+        Mail* mail = mail_new(MAIL_BROADCAST);
+        mail->exclude_id = sender->id;
+        atomic_fetch_add_explicit(&broadcast->refcnt, 1, memory_order_relaxed);
+        mail->broadcast = broadcast;
+        shard_post(&shards[i], mail);
+    }
+    if (message_log_enabled) {
+        log_frame(LOG_STREAM_BROADCAST, broadcast_frame(broadcast, PROTO_COMPACT));
+    }
+    broadcast_release(broadcast);
+    // Les destinataires des autres réacteurs ne sont pas comptés un à un
+    int clients = atomic_load_explicit(&client_count, memory_order_relaxed);
+    histogram_observe(&self_shard->metrics.fanout[BROADCAST_SEND], clients > 0 ? clients - 1 : 0);
+}
+
+// Fonction pour gérer l'envoi d'un message privé à un client spécifique
+void handle_private_message(ClientNode* sender, const char* target_nickname, const char* message) {
+    struct message msgstruct;
+    memset(&msgstruct, 0, sizeof(msgstruct));
+    msgstruct.pld_len = strlen(message);
+    strncpy(msgstruct.nick_sender, sender->info->nickname, NICK_LEN - 1); // Utilisez le pseudonyme de l'expéditeur
+    msgstruct.type = UNICAST_SEND;
+    strncpy(msgstruct.infos, message, INFOS_LEN - 1);
+
+    // Seule la part du destinataire est verrouillée, le temps de lui confier la trame
+    NickShard* part = nick_shard(target_nickname);
+    pthread_rwlock_rdlock(&part->lock);
+    ClientNode* tmp = nick_index_find(target_nickname);
+    if (tmp) {
+        // La trame compacte du journal est celle du destinataire quand il utilise ce format
+        Fanout fanout;
+        fanout_init(&fanout, &msgstruct, message, msgstruct.pld_len);
+        fanout_queue(&fanout, tmp);
+        pthread_rwlock_unlock(&part->lock);
+        if (message_log_enabled) {
+            log_frame(LOG_STREAM_PRIVATE, fanout_frame(&fanout, PROTO_COMPACT));
+        }
+        fanout_done(&fanout);
+        trace_sampled(TRACE_INFO, "Message privé envoyé de %s à %s (%d octets).", sender->info->nickname, target_nickname, msgstruct.pld_len);
+        return;
+    }
+    pthread_rwlock_unlock(&part->lock);
+
+    char errorMsg[] = "Erreur: Destinataire non trouvé.";
+    msgstruct.pld_len = strlen(errorMsg);
+    strncpy(msgstruct.infos, errorMsg, INFOS_LEN - 1);
+    
+    queue_message(sender, &msgstruct, errorMsg, msgstruct.pld_len);
+    trace_sampled(TRACE_INFO, "Destinataire %s non trouvé. Message de %s non livré.", target_nickname, sender->info->nickname, 0);
+}
+
+// Fonction pour gérer la création d'un salon ; le créateur en devient le premier membre
+void handle_create_channel(ClientNode* client, const char* channel_name) {
+    struct message response_msg;
+    memset(&response_msg, 0, sizeof(struct message));
+    
+    ChannelShard* part = channel_shard(channel_name);
+    pthread_rwlock_wrlock(&part->lock);
+    if (channel_exists(channel_name)) {
+        response_msg.type = MULTICAST_CREATE_FAILED;
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "Erreur: Le salon '%s' existe déjà.", channel_name);
+    } else if (client->membership_count >= MAX_CHANNELS_PER_CLIENT) {
+        response_msg.type = MULTICAST_CREATE_FAILED;
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "Erreur: Vous êtes déjà membre de %d salons.", MAX_CHANNELS_PER_CLIENT);
+    } else {
+        Channel* channel = create_channel(channel_name);
+        channel_add_member(channel, client);
+        response_msg.type = MULTICAST_CREATE;
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "%s", channel_name);
+    }
+    pthread_rwlock_unlock(&part->lock);
+
+    queue_message(client, &response_msg, NULL, 0);
+}
+
+// Fonction pour gérer la demande de liste des salons
+void handle_channel_list_request(ClientNode* client) {
+    struct message response_msg;
+    memset(&response_msg, 0, sizeof(struct message));
+    response_msg.type = MULTICAST_LIST; 
+
+    // La liste est écrite directement dans infos : on s'arrête au premier salon qui ne tient plus
+    size_t used = snprintf(response_msg.infos, sizeof(response_msg.infos), "[Server]: Liste des salons:\n");
+
+    // Toutes les parts sont tenues en lecture : le nombre de membres de chaque salon ne bouge pas pendant la liste
+    for (int i = 0; i < DIRECTORY_SHARDS; i++) {
+        pthread_rwlock_rdlock(&channel_shards[i].lock);
+    }
+    pthread_mutex_lock(&channel_registry_lock);
+    for (Channel* tmp = channel_list_head; tmp; tmp = tmp->next) {
+        int written = snprintf(response_msg.infos + used, sizeof(response_msg.infos) - used, "                          - %s (%d)\n", tmp->name, tmp->member_count);
+        if (written < 0 || used + written >= sizeof(response_msg.infos)) {
+            response_msg.infos[used] = '\0';
+            break;
+        }
+        used += written;
+    }
+    pthread_mutex_unlock(&channel_registry_lock);
+    for (int i = DIRECTORY_SHARDS - 1; i >= 0; i--) {
+        pthread_rwlock_unlock(&channel_shards[i].lock);
+    }
+
+    queue_message(client, &response_msg, NULL, 0);
+}
+
+// Fonction pour notifier les membres d'un salon
+void notify_channel_members(Channel* channel, const char* message, ClientNode* exclude_client) {
+    struct message notification_msg;
+    memset(&notification_msg, 0, sizeof(notification_msg));
+    notification_msg.type = MULTICAST_NOTIFICATION; 
+
+    strncpy(notification_msg.infos, message, INFOS_LEN - 1);
+    strncpy(notification_msg.nick_sender, channel->name, CHANNEL_LEN - 1);
+
+    Fanout fanout;
+    fanout_init(&fanout, &notification_msg, NULL, 0);
+    for (int i = 0; i < channel->member_count; i++) {
+        if (channel->roster[i].node != exclude_client) {
+            fanout_queue_member(&fanout, &channel->roster[i]);
+        }
+    }
+    fanout_done(&fanout);
+}
+
+// Fonction pour diffuser un message aux autres membres du salon nommé dans infos
+// Seule la part du salon est tenue, en lecture : les envois à des salons différents ne se gênent pas
+void handle_multicast_send(ClientNode* client, const char* channel_name, const char* message) {
+    ChannelShard* part = channel_shard(channel_name);
+    pthread_rwlock_rdlock(&part->lock);
+    Channel* channel = find_channel(channel_name);
+    if (!channel || !find_membership(client, channel)) {
+        pthread_rwlock_unlock(&part->lock);
+        struct message response_msg;
+        memset(&response_msg, 0, sizeof(response_msg));
+        response_msg.type = MULTICAST_NOTIFICATION;
+        strncpy(response_msg.nick_sender, channel_name, CHANNEL_LEN - 1);
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "Erreur : Vous n'êtes pas dans le salon '%s'.", channel_name);
+        queue_message(client, &response_msg, NULL, 0);
+        return;
+    }
+
+    struct message multicast_msg;
+    memset(&multicast_msg, 0, sizeof(multicast_msg));
+    multicast_msg.type = MULTICAST_SEND;
+    strncpy(multicast_msg.nick_sender, client->info->nickname, NICK_LEN - 1);
+    strncpy(multicast_msg.infos, channel->name, CHANNEL_LEN - 1);
+    multicast_msg.pld_len = strlen(message);
+
+    Fanout fanout;
+    fanout_init(&fanout, &multicast_msg, message, multicast_msg.pld_len);
+    for (int i = 0; i < channel->member_count; i++) {
+        if (channel->roster[i].node != client) {
+            fanout_queue_member(&fanout, &channel->roster[i]);
+        }
+    }
+    if (history_replay > 0) {
+        channel_history_record(channel, &fanout);
+    }
+    if (message_log_enabled) {
+        log_channel_message(channel, &fanout);
+    }
+    pthread_rwlock_unlock(&part->lock);
+    fanout_done(&fanout);
+}
+
+// Fonction pour gérer la sortie d'un client d'un salon
+void handle_multicast_quit(ClientNode* client, const char* channel_name) {
+    struct message response_msg;
+    memset(&response_msg, 0, sizeof(response_msg));
+    response_msg.type = MULTICAST_QUIT;
+
+    ChannelShard* part = channel_shard(channel_name);
+    pthread_rwlock_wrlock(&part->lock);
+    Channel* channel = find_channel(channel_name);
+    if (channel && find_membership(client, channel)) {
+        queue_message(client, &response_msg, NULL, 0);
+        char quit_message[INFOS_LEN];
+        snprintf(quit_message, INFOS_LEN, " %s a quitté le salon.", client->info->nickname);
+        notify_channel_members(channel, quit_message, client);
+
+        channel_remove_member(channel, client);
+        trace_event(TRACE_INFO, "Le client %s a quitté le salon '%s'.", client->info->nickname, channel_name, 0);
+
+        if (delete_channel_if_empty(channel)) {
+            snprintf(response_msg.infos, sizeof(response_msg.infos), "Vous avez quitté le salon '%s', qui a été supprimé car vous étiez le dernier membre.", channel_name);
+        } else {
+            snprintf(response_msg.infos, sizeof(response_msg.infos), "Vous avez quitté le salon '%s'.", channel_name);
+        }
+    } else {
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "Erreur : Vous n'êtes pas dans le salon '%s'.", channel_name);
+    }
+    pthread_rwlock_unlock(&part->lock);
+
+    queue_message(client, &response_msg, NULL, 0);
+}
+
+// Fonction pour gérer l'adhésion d'un client à un salon ; il reste membre des autres
+void handle_multicast_join(ClientNode* client, const char* channel_name) {
+    struct message response_msg;
+    memset(&response_msg, 0, sizeof(struct message));
+    response_msg.type = MULTICAST_JOIN;
+
+    ChannelShard* part = channel_shard(channel_name);
+    pthread_rwlock_wrlock(&part->lock);
+    Channel* channel = find_channel(channel_name);
+    bool joined = false;
+    if (!channel) {
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "Erreur : Le salon '%s' n'existe pas.", channel_name);
+    } else if (find_membership(client, channel)) {
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "Vous êtes déjà dans le salon '%s'.", channel_name);
+    } else if (client->membership_count >= MAX_CHANNELS_PER_CLIENT) {
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "Erreur : Vous êtes déjà membre de %d salons.", MAX_CHANNELS_PER_CLIENT);
+    } else {
+        channel_add_member(channel, client);
+        joined = true;
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "Vous avez rejoint le salon '%s'.", channel_name);
+
+        char join_message[INFOS_LEN];
+        snprintf(join_message, INFOS_LEN, "%s a rejoint le salon", client->info->nickname);
+        notify_channel_members(channel, join_message, client);
+    }
+
+    queue_message(client, &response_msg, NULL, 0);
+    // L'historique suit l'acquittement ; le salon ne peut pas disparaître tant que la part est tenue
+    if (joined) {
+        channel_history_replay(channel, client);
+    }
+    pthread_rwlock_unlock(&part->lock);
+}
+
+// Fonction pour envoyer à un client les messages d'un salon lus dans le journal : les LOG_QUERY_MAX
+// derniers, ou ceux d'avant si skip_text demande d'en sauter un certain nombre parmi les plus récents
+// Le verrou de la part du salon n'est pris que pour vérifier l'appartenance. La lecture part
+// de l'ancre de l'index épars qui précède le premier message voulu et avance dans les segments projetés
+// jusqu'au dernier ; seules les trames envoyées au client sont copiées.
+void handle_multicast_history(ClientNode* client, const char* channel_name, const char* skip_text) {
+    struct message response_msg;
+    memset(&response_msg, 0, sizeof(response_msg));
+    response_msg.type = MULTICAST_HISTORY;
+
+    if (!message_log_enabled) {
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "Erreur : Le journal des messages est désactivé.");
+        queue_message(client, &response_msg, NULL, 0);
+        return;
+    }
+    LogChannel* index = NULL;
+    ChannelShard* part = channel_shard(channel_name);
+    pthread_rwlock_rdlock(&part->lock);
+    Channel* channel = find_channel(channel_name);
+    if (channel && find_membership(client, channel)) {
+        index = channel->log;
+    }
+    pthread_rwlock_unlock(&part->lock);
+    if (!index) {
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "Erreur : Vous n'êtes pas dans le salon '%s'.", channel_name);
+        queue_message(client, &response_msg, NULL, 0);
+        return;
+    }
+
+    // Messages numérotés [start, end) à rendre, et les ancres qui les couvrent
+    unsigned long skip = strtoul(skip_text, NULL, 10);
+    uint64_t anchors[LOG_QUERY_MAX / LOG_INDEX_INTERVAL + 2];
+    int anchor_count = 0;
+    pthread_mutex_lock(&index->lock);
+    unsigned long end = skip < index->count ? index->count - skip : 0;
+    unsigned long start = end > LOG_QUERY_MAX ? end - LOG_QUERY_MAX : 0;
+    if (start < index->anchor_base * LOG_INDEX_INTERVAL) {
+        start = index->anchor_base * LOG_INDEX_INTERVAL;
+    }
+    unsigned long first_anchor = start / LOG_INDEX_INTERVAL;
+    for (unsigned long a = first_anchor; a * LOG_INDEX_INTERVAL < end && a - index->anchor_base < index->anchor_count; a++) {
+        anchors[anchor_count++] = index->anchors[a - index->anchor_base];
+    }
+    uint64_t last = index->last;
+    unsigned long total = index->count;
+    pthread_mutex_unlock(&index->lock);
+
+    int found = 0;
+    LogCursor cursor;
+    seglog_cursor_open(&message_log, &cursor);
+    // Une ancre dont le segment a été supprimé ne sert plus : la lecture part de la suivante
+    int a = 0;
+    while (a < anchor_count && !seglog_cursor_covers(&cursor, anchors[a])) {
+        a++;
+    }
+    if (a < anchor_count) {
+        unsigned long number = (first_anchor + a) * LOG_INDEX_INTERVAL;
+        uint64_t offset = anchors[a];
+        const LogRecord* rec;
+        while (number < end && offset <= last && (rec = seglog_cursor_next(&cursor, &offset)) != NULL) {
+            struct message msg;
+            char payload[COMPACT_MAX_PAYLOAD + 1];
+            if (!log_record_in_channel(rec, index, &msg, payload) || number++ < start) {
+                continue;
+            }
+            if (client->proto == PROTO_COMPACT) {
+                queue_frame(client, frame_from_wire(rec->data, compact_frame_len(rec->data)));
+            } else {
+                queue_message(client, &msg, payload, msg.pld_len);
+            }
+            found++;
+        }
+    }
+    seglog_cursor_close(&cursor);
+
+    if (found > 0 && end - found > index->anchor_base * LOG_INDEX_INTERVAL) {
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "%d message(s) de l'historique du salon '%s' ; les précédents : /history %s %lu", found,
+                 channel_name, channel_name, total - (end - found));
+    } else {
+        snprintf(response_msg.infos, sizeof(response_msg.infos), "%d message(s) de l'historique du salon '%s'.", found, channel_name);
+    }
+    queue_message(client, &response_msg, NULL, 0);
+}
+
+// Fonction pour gérer une demande de transfert de fichier
+void handle_file_request(ClientNode* sender, const char* target_nickname, const char* file_path) {
+    struct message msgstruct;
+    memset(&msgstruct, 0, sizeof(msgstruct));
+    msgstruct.type = FILE_REQUEST;
+    strncpy(msgstruct.nick_sender, sender->info->nickname, NICK_LEN - 1);
+    msgstruct.pld_len = strlen(file_path);
+
+    pthread_mutex_lock(&file_lock);
+    NickShard* part = nick_shard(target_nickname);
+    pthread_rwlock_rdlock(&part->lock);
+    ClientNode* tmp = nick_index_find(target_nickname);
+    if (tmp) {
+        queue_message(tmp, &msgstruct, file_path, msgstruct.pld_len);
+
+        strncpy(tmp->info->file_transfer_sender, sender->info->nickname, NICK_LEN - 1);
+        // Sans réponse à temps, la demande est annulée (voir file_request_expired())
+        strncpy(sender->info->file_request_target, tmp->info->nickname, NICK_LEN - 1);
+        timer_arm(&self_shard->wheel, &sender->file_timer, FILE_REQUEST_TIMEOUT_MS, self_shard->now);
+    }
+    pthread_rwlock_unlock(&part->lock);
+    pthread_mutex_unlock(&file_lock);
+}
+
+// Fonction appelée quand une demande de transfert de fichier reste sans réponse
+// Le destinataire ne peut plus l'accepter ; l'expéditeur reçoit un FILE_REJECT
+void file_request_expired(ClientNode* sender) {
+    pthread_mutex_lock(&file_lock);
+    NickShard* part = nick_shard(sender->info->file_request_target);
+    pthread_rwlock_rdlock(&part->lock);
+    ClientNode* target = nick_index_find(sender->info->file_request_target);
+    bool expired = target && strcmp(target->info->file_transfer_sender, sender->info->nickname) == 0;
+    if (expired) {
+        memset(target->info->file_transfer_sender, 0, NICK_LEN);
+    }
+    pthread_rwlock_unlock(&part->lock);
+    pthread_mutex_unlock(&file_lock);
+
+    if (expired) {
+        struct message response_msg;
+        memset(&response_msg, 0, sizeof(response_msg));
+        response_msg.type = FILE_REJECT;
+        strncpy(response_msg.nick_sender, sender->info->file_request_target, NICK_LEN - 1);
+        strncpy(response_msg.infos, "Demande de transfert expirée.", INFOS_LEN - 1);
+        queue_message(sender, &response_msg, NULL, 0);
+        trace_event(TRACE_INFO, "Demande de transfert de %s vers %s expirée.", sender->info->nickname, sender->info->file_request_target, 0);
+    }
+}
+
+// Fonction pour gérer la réponse à une demande de transfert de fichier
+void handle_file_response(ClientNode* client, enum msg_type response_type) {
+    struct message response_msg;
+    memset(&response_msg, 0, sizeof(response_msg));
+    response_msg.type = response_type;
+    strncpy(response_msg.nick_sender, client->info->nickname, NICK_LEN - 1);
+
+    pthread_mutex_lock(&file_lock);
+    NickShard* part = nick_shard(client->info->file_transfer_sender);
+    pthread_rwlock_rdlock(&part->lock);
+    ClientNode* tmp = nick_index_find(client->info->file_transfer_sender);
+    if (tmp) {
+        queue_message(tmp, &response_msg, NULL, 0);
+        memset(client->info->file_transfer_sender, 0, NICK_LEN);
+    }
+    pthread_rwlock_unlock(&part->lock);
+    pthread_mutex_unlock(&file_lock);
+}
+
+// Fonction pour traiter le premier message d'une connexion, qui doit être son NICKNAME_NEW
+// Le client entre alors dans l'annuaire ; retourne -1 si la connexion doit être fermée
+int identify_client(ClientNode* client, struct message* msg) {
+    if (msg->type != NICKNAME_NEW) {
+        trace_event(TRACE_WARN, "Le client n'a pas fourni un pseudo correctement.", NULL, NULL, 0);
+        return -1;
+    }
+
+    // Négociation du format : l'acquittement part toujours au format historique,
+    // avec pld_len = version retenue ; le client passe ensuite au format compact
+    bool compact = strcmp(msg->infos, PROTO_COMPACT_HELLO) == 0;
+
+    // Le verrou de la part du pseudo couvre la vérification et l'enregistrement : deux réacteurs
+    // ne peuvent pas attribuer le même pseudo en même temps
+    NickShard* part = nick_shard(msg->nick_sender);
+    pthread_rwlock_wrlock(&part->lock);
+    if (is_nickname_taken(msg->nick_sender, NULL)) {
+        pthread_rwlock_unlock(&part->lock);
         struct message response_msg;
+        memset(&response_msg, 0, sizeof(response_msg));
         response_msg.type = NICKNAME_DOUBLON;
-        send(connfd, &response_msg, sizeof(response_msg), 0);
-        close(connfd);
-        return;
+        queue_message(client, &response_msg, NULL, 0);
+        close_client(client, CLOSE_NICKNAME);
+        return -1;
     }
 
-    ClientNode* new_client = add_new_client(connfd, (struct sockaddr*)&cli_addr);
-    strncpy(new_client->nickname, msg.nick_sender, NICK_LEN - 1);
+    // Le format est fixé avant la publication : les autres réacteurs encodent dès lors au bon format
+    if (compact) {
+        client->proto = PROTO_COMPACT;
+        client_hot(client)->proto = PROTO_COMPACT;
+    }
+    strncpy(client->info->nickname, msg->nick_sender, NICK_LEN - 1);
+    publish_client(client);
+    nick_index_insert(client);
+    pthread_rwlock_unlock(&part->lock);
+
+    // La temporisation d'identification devient celle du keepalive, pour les seuls clients qui
+    // ont annoncé le format compact : le client historique ignore les PING et n'envoie jamais de PONG,
+    // un lecteur silencieux serait déconnecté. Pour lui, c'est le keepalive TCP qui repère un pair disparu
+    client->identified = true;
+    client->keepalive = compact;
+    client_hot(client)->flags |= HOT_IDENTIFIED;
+    client->last_activity = self_shard->now;
+    if (client->keepalive) {
+        timer_arm(&self_shard->wheel, &client->timer, keepalive_ms < idle_timeout_ms ? keepalive_ms : idle_timeout_ms, self_shard->now);
+    } else {
+        timer_cancel(&self_shard->wheel, &client->timer);
+        enable_tcp_keepalive(client->fd);
+    }
 
     struct message response_msg;
+    memset(&response_msg, 0, sizeof(response_msg));
     response_msg.type = NICKNAME_NEW;
-    strncpy(response_msg.infos, new_client->nickname, INFOS_LEN - 1);
-    send(connfd, &response_msg, sizeof(response_msg), 0);
+    response_msg.pld_len = compact ? PROTO_COMPACT : PROTO_LEGACY;
+    strncpy(response_msg.infos, client->info->nickname, INFOS_LEN - 1);
+    // Les trames venues d'autres réacteurs passent par la boîte aux lettres, vidée après ce retour :
+    // l'acquittement reste la première trame de la file
+    Frame* ack = frame_new(PROTO_LEGACY, &response_msg, NULL, 0);
+    if (ack) {
+        queue_frame(client, ack);
+    }
+
+    trace_event(TRACE_INFO, "Bienvenue sur le serveur, %s!", client->info->nickname, NULL, 0);
+    return 0;
+}
 
-    printf("Bienvenue sur le serveur, %s!\n", new_client->nickname);
+// Fonction pour accepter toutes les connexions en attente sur une socket d'écoute non bloquante
+// Lors d'un afflux de connexions, un seul réveil suffit à vider la file du noyau
+// Les nouvelles connexions attendent leur NICKNAME_NEW dans la boucle d'événements, sans bloquer personne
+void handle_new_connection(int sfd) {
+    while (1) {
+        struct sockaddr_storage cli_addr;
+        socklen_t len = sizeof(cli_addr);
+        int connfd = accept4(sfd, (struct sockaddr*)&cli_addr, &len, SOCK_NONBLOCK);
+        if (connfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept()");
+            }
+            return;
+        }
+        counter_add(&self_shard->metrics.accepted, 1);
+        assign_shard(add_new_client(connfd, (struct sockaddr*)&cli_addr));
+    }
 }
 
 // Fonction pour effectuer la liaison sur un port donné
-int handle_bind(const char* port) {
+// Avec reuseport, plusieurs sockets peuvent être liées au même port (SO_REUSEPORT)
+int handle_bind(const char* port, bool reuseport) {
     struct addrinfo hints, *res;
     int sfd;
 
@@ -555,6 +2142,14 @@ int handle_bind(const char* port) {
         exit(EXIT_FAILURE);
     }
 
+    int one = 1;
+    if (reuseport && setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1) {
+        perror("setsockopt(SO_REUSEPORT)");
+        close(sfd);
+        freeaddrinfo(res);
+        exit(EXIT_FAILURE);
+    }
+
     if (bind(sfd, res->ai_addr, res->ai_addrlen) == -1) {
         perror("bind");
         close(sfd);
@@ -566,153 +2161,769 @@ int handle_bind(const char* port) {
     return sfd;
 }
 
-// Fonction principale pour gérer la communication avec les clients
-void echo_server(ClientNode* client) {
-    struct message msgstruct;
-    char buff[MSG_LEN];
-    int bytes_received;
-
-    memset(buff, 0, sizeof(buff));
-
-    bytes_received = recv(client->pfd.fd, &msgstruct, sizeof(msgstruct), 0);
-    if (bytes_received <= 0) {
-        printf("Le client s'est déconnecté ou une erreur est survenue.\n");
-        close(client->pfd.fd);
-        remove_client(client);
-        return;
-    }
-    if (msgstruct.type == NICKNAME_NEW) {
-        strncpy(client->nickname, msgstruct.nick_sender, NICK_LEN - 1);
-    } else if (msgstruct.type == NICKNAME_CHANGEMENT) {
-        const char* new_nickname = msgstruct.infos; 
-        handle_nick_change(client, new_nickname);
-    } else if (msgstruct.type == NICKNAME_LIST) {
+// Fonction pour aiguiller un message d'un client vers son traitement
+// Retourne -1 si le client doit être fermé
+int dispatch_message(ClientNode* client, struct message* msgstruct, char* payload) {
+    if (msgstruct->type == NICKNAME_NEW) {
+        // Un nouveau NICKNAME_NEW après l'identification vaut changement de pseudo, doublons vérifiés
+        if (handle_nick_change(client, msgstruct->nick_sender) < 0) {
+            return -1;
+        }
+    } else if (msgstruct->type == NICKNAME_CHANGEMENT) {
+        const char* new_nickname = msgstruct->infos; 
+        if (handle_nick_change(client, new_nickname) < 0) {
+            return -1;
+        }
+    } else if (msgstruct->type == NICKNAME_LIST) {
         handle_who_request(client);
-    } else if (msgstruct.type == NICKNAME_INFOS) {
-        const char* target_nickname = msgstruct.infos;
+    } else if (msgstruct->type == NICKNAME_INFOS) {
+        const char* target_nickname = msgstruct->infos;
         handle_whois_request(client, target_nickname);
-    } else if (msgstruct.type == BROADCAST_SEND) {
-        printf("Broadcast from %s: %s\n", client->nickname, msgstruct.infos);
-        broadcast_message(client, msgstruct.infos);
-    } else if (msgstruct.type == UNICAST_SEND) {
+    } else if (msgstruct->type == BROADCAST_SEND) {
+        trace_sampled(TRACE_INFO, "Diffusion de %s.", client->info->nickname, NULL, 0);
+        broadcast_message(client, msgstruct->infos);
+    } else if (msgstruct->type == UNICAST_SEND) {
         char target_nickname[NICK_LEN];
-        char private_message[INFOS_LEN];
-        strncpy(target_nickname, msgstruct.infos, NICK_LEN - 1); 
+        char* private_message = payload;
+        strncpy(target_nickname, msgstruct->infos, NICK_LEN - 1); 
         target_nickname[NICK_LEN-1] = '\0'; 
-        recv(client->pfd.fd, private_message, msgstruct.pld_len, 0);
-        private_message[msgstruct.pld_len] = '\0'; 
-        printf("Private message from %s to %s: %s\n", msgstruct.nick_sender, target_nickname, private_message);
         handle_private_message(client, target_nickname, private_message);
-    } else if (msgstruct.type == MULTICAST_CREATE) {
-        handle_create_channel(client, msgstruct.infos);
-    } else if (msgstruct.type == MULTICAST_LIST) {
+    } else if (msgstruct->type == MULTICAST_CREATE) {
+        msgstruct->infos[CHANNEL_LEN - 1] = '\0';
+        handle_create_channel(client, msgstruct->infos);
+    } else if (msgstruct->type == MULTICAST_LIST) {
         handle_channel_list_request(client);
-    } else if (msgstruct.type == MULTICAST_QUIT) {
-        handle_multicast_quit(client, msgstruct.infos);
-    } else if (msgstruct.type == MULTICAST_JOIN) {
-        handle_multicast_join(client, msgstruct.infos);
-    } else if (msgstruct.type == MULTICAST_SEND) {
-        char multicast_message[MSG_LEN];
-        memset(multicast_message, 0, sizeof(multicast_message));
-
-        bytes_received = recv(client->pfd.fd, multicast_message, msgstruct.pld_len, 0);
-        if (bytes_received <= 0) {
-            printf("Le client s'est déconnecté ou une erreur est survenue.\n");
-            close(client->pfd.fd);
-            remove_client(client);
-        } else {
-            for (ClientNode* tmp = head; tmp; tmp = tmp->next) {
-                if (tmp != client && strcmp(tmp->channel_name, client->channel_name) == 0) {
-                    struct message multicast_msg;
-                    memset(&multicast_msg, 0, sizeof(multicast_msg));
-                    multicast_msg.type = MULTICAST_SEND;
-                    strncpy(multicast_msg.nick_sender, client->nickname, NICK_LEN - 1); 
-                    strncpy(multicast_msg.infos, client->channel_name, CHANNEL_LEN - 1); 
-                    multicast_msg.pld_len = strlen(multicast_message); 
-
-                    send(tmp->pfd.fd, &multicast_msg, sizeof(multicast_msg), 0);
-                    send(tmp->pfd.fd, multicast_message, multicast_msg.pld_len, 0);
+    } else if (msgstruct->type == MULTICAST_QUIT) {
+        msgstruct->infos[CHANNEL_LEN - 1] = '\0';
+        handle_multicast_quit(client, msgstruct->infos);
+    } else if (msgstruct->type == MULTICAST_JOIN) {
+        msgstruct->infos[CHANNEL_LEN - 1] = '\0';
+        handle_multicast_join(client, msgstruct->infos);
+    } else if (msgstruct->type == MULTICAST_SEND) {
+        msgstruct->infos[CHANNEL_LEN - 1] = '\0';
+        handle_multicast_send(client, msgstruct->infos, payload);
+    } else if (msgstruct->type == MULTICAST_HISTORY) {
+        msgstruct->infos[CHANNEL_LEN - 1] = '\0';
+        handle_multicast_history(client, msgstruct->infos, payload);
+    } else if (msgstruct->type == FILE_REQUEST) {
+        handle_file_request(client, msgstruct->infos, payload);
+    } else if (msgstruct->type == FILE_ACCEPT || msgstruct->type == FILE_REJECT) {
+        handle_file_response(client, msgstruct->type);
+    } else if (msgstruct->type == PONG) {
+        // Réponse au keepalive : l'activité a déjà été notée par drain_client()
+    } else {
+        const char* type_str = (unsigned)msgstruct->type < MSG_TYPE_COUNT ? msg_type_str[msgstruct->type] : "?";
+        trace_sampled(TRACE_WARN, "Message de type %s inattendu de %s (pld_len = %d).", type_str, client->info->nickname, msgstruct->pld_len);
+    }
+    return 0;
+}
+
+// Fonction pour ouvrir une socket d'écoute non bloquante sur un port donné
+int open_listener(const char* port, bool reuseport) {
+    int sfd = handle_bind(port, reuseport);
+
+    if (listen(sfd, SOMAXCONN) != 0) {
+        perror("listen()\n");
+        exit(EXIT_FAILURE);
+    }
+    if (set_nonblocking(sfd) == -1) {
+        exit(EXIT_FAILURE);
+    }
+    return sfd;
+}
+
+// Fonction pour ouvrir la socket d'administration (Unix, locale) sur laquelle les métriques sont lues
+void open_admin_socket(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Chemin de socket d'administration trop long : %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, path);
+
+    admin_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (admin_fd == -1) {
+        perror("socket(AF_UNIX)");
+        exit(EXIT_FAILURE);
+    }
+    // Une socket laissée par une exécution précédente empêcherait bind()
+    unlink(path);
+    if (bind(admin_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(admin_fd, 16) == -1) {
+        perror("bind(admin)");
+        exit(EXIT_FAILURE);
+    }
+    if (set_nonblocking(admin_fd) == -1) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Fonction principale pour gérer la communication avec les clients
+// Appelée par le décodeur pour chaque trame complète ; payload est terminé par '\0'
+// Chaque traitement ne verrouille que la part de l'annuaire qu'il consulte : le pseudo ou le salon visé
+// Retourne -1 si le client doit être fermé
+int echo_server(ClientNode* client, struct message* msgstruct, char* payload) {
+    if (!client->identified) {
+        return identify_client(client, msgstruct);
+    }
+    return dispatch_message(client, msgstruct, payload);
+}
+
+// Fonction pour savoir si une trame du client est suivie d'une charge utile de pld_len octets
+// Dans le protocole historique, seuls ces types envoient réellement la charge utile
+bool frame_has_payload(enum msg_type type) {
+    switch (type) {
+    case NICKNAME_NEW:
+    case NICKNAME_LIST:
+    case NICKNAME_INFOS:
+    case NICKNAME_CHANGEMENT:
+    case BROADCAST_SEND:
+    case MULTICAST_CREATE:
+    case MULTICAST_LIST:
+    case MULTICAST_JOIN:
+    case MULTICAST_QUIT:
+    case FILE_ACCEPT:
+    case FILE_REJECT:
+    case PING:
+    case PONG:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Fonction pour extraire len octets en tête de l'anneau de réception
+void rx_consume(ClientNode* client, void* dst, size_t len) {
+    size_t start = client->rx_head & (RX_RING_SIZE - 1);
+    size_t first = RX_RING_SIZE - start < len ? RX_RING_SIZE - start : len;
+    memcpy(dst, client->rx_ring + start, first);
+    memcpy((char*)dst + first, client->rx_ring, len - first);
+    client->rx_head += len;
+}
+
+// Fonction pour copier len octets en tête de l'anneau de réception sans les consommer
+void rx_peek(ClientNode* client, void* dst, size_t len) {
+    size_t head = client->rx_head;
+    rx_consume(client, dst, len);
+    client->rx_head = head;
+}
+
+// Décodeur incrémental : traite toutes les trames complètes présentes dans l'anneau
+// et conserve l'état (en-tête lu, charge utile attendue) pour la lecture suivante
+int process_frames(ClientNode* client) {
+    while (!client->closing) {
+        size_t available = client->rx_tail - client->rx_head;
+        struct message* msg = &client->rx_msg;
+        char payload[MAX_PAYLOAD_LEN + 1];
+        size_t wire_len;
+
+        if (client->proto == PROTO_COMPACT) {
+            // Format compact : la longueur totale est connue dès les deux premiers octets
+            char frame[COMPACT_MAX_FRAME];
+            if (available < 2) {
+                return 0;
+            }
+            rx_peek(client, frame, 2);
+            size_t frame_len = compact_frame_len(frame);
+            if (frame_len < COMPACT_HEADER_LEN || frame_len > COMPACT_MAX_FRAME) {
+                trace_event(TRACE_WARN, "Trame compacte invalide (%zu octets), fermeture de la connexion.", NULL, NULL, frame_len);
+                return -1;
+            }
+            if (available < frame_len) {
+                return 0;
+            }
+            rx_consume(client, frame, frame_len);
+            wire_len = frame_len;
+            if (compact_decode(frame, frame_len, msg, payload) < 0) {
+                trace_event(TRACE_WARN, "Trame compacte mal formée, fermeture de la connexion.", NULL, NULL, 0);
+                return -1;
+            }
+        } else if (client->rx_state == RX_HEADER) {
+            if (available < sizeof(struct message)) {
+                return 0;
+            }
+            rx_consume(client, msg, sizeof(struct message));
+            msg->nick_sender[NICK_LEN - 1] = '\0';
+            msg->infos[INFOS_LEN - 1] = '\0';
+            if (frame_has_payload(msg->type)) {
+                if (msg->pld_len < 0 || msg->pld_len > MAX_PAYLOAD_LEN) {
+                    trace_event(TRACE_WARN, "Trame invalide (pld_len = %d), fermeture de la connexion.", NULL, NULL, msg->pld_len);
+                    return -1;
                 }
+                client->rx_state = RX_PAYLOAD;
+                continue;
             }
+            payload[0] = '\0';
+            wire_len = sizeof(struct message);
+        } else {
+            if (available < (size_t)msg->pld_len) {
+                return 0;
+            }
+            rx_consume(client, payload, msg->pld_len);
+            payload[msg->pld_len] = '\0';
+            client->rx_state = RX_HEADER;
+            wire_len = sizeof(struct message) + msg->pld_len;
         }
-    } else if (msgstruct.type == FILE_REQUEST) {
-        char file_path[MSG_LEN];
-        recv(client->pfd.fd, file_path, msgstruct.pld_len, 0);
-        file_path[msgstruct.pld_len] = '\0';
-        handle_file_request(client, msgstruct.infos, file_path);
-    } else if (msgstruct.type == FILE_ACCEPT || msgstruct.type == FILE_REJECT) {
-        handle_file_response(client, msgstruct.type);
-    } else {
-            char received_msg[MSG_LEN];
-        memset(received_msg, 0, sizeof(received_msg));
-
-        bytes_received = recv(client->pfd.fd, received_msg, msgstruct.pld_len, 0);
-        if (bytes_received <= 0) {
-            printf("Le client s'est déconnecté ou une erreur est survenue.\n");
-            close(client->pfd.fd);
-            remove_client(client);
+
+        Metrics* metrics = &self_shard->metrics;
+        unsigned type = (unsigned)msg->type < MSG_TYPE_COUNT ? msg->type : MSG_TYPE_COUNT;
+        counter_add(&metrics->received[type], 1);
+        counter_add(&metrics->received_bytes[type], wire_len);
+        long long start = now_ns();
+        int ret = echo_server(client, msg, payload);
+        histogram_observe(&metrics->handling_ns[type], now_ns() - start);
+        if (ret < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Fonction pour lire tout ce qui est disponible sur la socket d'un client
+// En mode edge-triggered, il faut vider la socket avant de rendre la main à epoll
+void drain_client(ClientNode* client) {
+    if (!client->rx_ring) {
+        client->rx_ring = slab_alloc(RX_RING_SIZE);
+    }
+
+    while (!client->closing) {
+        // L'espace libre de l'anneau forme au plus deux segments contigus
+        size_t used = client->rx_tail - client->rx_head;
+        size_t start = client->rx_tail & (RX_RING_SIZE - 1);
+        size_t free_space = RX_RING_SIZE - used;
+        struct iovec iov[2];
+        int iovcnt = 1;
+        iov[0].iov_base = client->rx_ring + start;
+        iov[0].iov_len = RX_RING_SIZE - start < free_space ? RX_RING_SIZE - start : free_space;
+        if (iov[0].iov_len < free_space) {
+            iov[1].iov_base = client->rx_ring;
+            iov[1].iov_len = free_space - iov[0].iov_len;
+            iovcnt = 2;
+        }
+
+        ssize_t n = readv(client->fd, iov, iovcnt);
+        if (n > 0) {
+            client->rx_tail += n;
+            client->last_activity = self_shard->now;
+            if (process_frames(client) < 0) {
+                close_client(client, CLOSE_PROTOCOL);
+            }
+        } else if (n == 0) {
+            trace_event(TRACE_INFO, "Le client %s s'est déconnecté.", client->info->nickname, NULL, 0);
+            close_client(client, CLOSE_PEER);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
             return;
+        } else if (errno != EINTR) {
+            trace_event(TRACE_INFO, "Erreur de lecture (errno %d), client %s déconnecté.", client->info->nickname, NULL, errno);
+            close_client(client, CLOSE_ERROR);
         }
+    }
+}
 
-        printf("pld_len: %i / nick_sender: %s / type: %s, infos: %s\n", msgstruct.pld_len, msgstruct.nick_sender, msg_type_str[msgstruct.type], msgstruct.infos);
-        printf("Reçu: %s\n", received_msg);
+// Fonction pour traiter les messages déposés par les autres réacteurs
+void shard_drain_mailbox(Shard* shard) {
+    Mail* mail;
+    while ((mail = mailbox_pop(&shard->mailbox)) != NULL) {
+        if (mail->kind == MAIL_ADOPT) {
+            shard_attach(shard, mail->client);
+        } else if (mail->kind == MAIL_FRAME) {
+            queue_frame(mail->client, mail->frame);
+            atomic_fetch_sub_explicit(&mail->client->mail_pending, 1, memory_order_relaxed);
+        } else {
+            broadcast_to_shard(shard, mail->broadcast, mail->exclude_id);
+            broadcast_release(mail->broadcast);
+        }
+        slab_free(mail, sizeof(Mail));
     }
 }
 
-// Boucle de sondage principale du serveur
-void poll_loop(int sfd) {
-    while (1) {
-        struct pollfd pfds[MAX_CLIENTS + 1];
-        ClientNode* client_nodes[MAX_CLIENTS + 1];
+// Fonction pour fermer les clients marqués pendant le tour de boucle
+void reap_closed_clients() {
+    ClientNode* list = self_shard->closing_list;
+    if (!list) {
+        return;
+    }
+    self_shard->closing_list = NULL;
+
+    for (ClientNode* client = list; client; client = client->close_next) {
+        // Dernier essai pour livrer une réponse déjà en file (ex. NICKNAME_DOUBLON)
+        flush_client(client);
+    }
+    for (ClientNode* client = list; client; client = client->close_next) {
+        if (client->identified) {
+            unpublish_client(client);
+        }
+    }
+
+    // D'autres réacteurs ont pu déposer des trames pour ces clients tant qu'ils figuraient
+    // dans l'annuaire : elles doivent être relâchées avant de libérer les clients.
+    // mailbox_pop() ne voit pas les lettres placées derrière un dépôt encore à moitié fait :
+    // on vide la boîte jusqu'à ce que plus aucune trame ne soit en route vers ces clients
+    shard_drain_mailbox(self_shard);
+    for (ClientNode* client = list; client; client = client->close_next) {
+        while (atomic_load_explicit(&client->mail_pending, memory_order_relaxed) > 0) {
+            sched_yield();
+            shard_drain_mailbox(self_shard);
+        }
+    }
+    while (list) {
+        ClientNode* client = list;
+        list = client->close_next;
+        remove_client(client);
+    }
+}
+
+// Fonction appelée à l'échéance de la temporisation d'un client : délai d'identification
+// dépassé, ou vérification de keepalive d'un client qui répond aux PING (PING après keepalive_ms
+// de silence, déconnexion après idle_timeout_ms, ce qui libère aussi le pseudo d'un pair disparu)
+void client_timer_expired(Shard* shard, ClientNode* client) {
+    if (!client->identified) {
+        trace_event(TRACE_INFO, "Le client n'a pas fourni de pseudo à temps, fermeture de la connexion.", NULL, NULL, 0);
+        close_client(client, CLOSE_HANDSHAKE_TIMEOUT);
+        return;
+    }
+
+    long long idle = shard->now - client->last_activity;
+    if (idle >= idle_timeout_ms) {
+        trace_event(TRACE_INFO, "Client %s inactif depuis %lld s : déconnexion.", client->info->nickname, NULL, idle / 1000);
+        close_client(client, CLOSE_IDLE_TIMEOUT);
+        return;
+    }
+
+    long long next = idle_timeout_ms - idle;
+    if (idle >= keepalive_ms) {
+        struct message ping_msg;
+        memset(&ping_msg, 0, sizeof(ping_msg));
+        ping_msg.type = PING;
+        queue_message(client, &ping_msg, NULL, 0);
+        if (keepalive_ms < next) {
+            next = keepalive_ms;
+        }
+    } else if (keepalive_ms - idle < next) {
+        next = keepalive_ms - idle;
+    }
+    timer_arm(&shard->wheel, &client->timer, next, shard->now);
+}
+
+// Fonction pour traiter les temporisations échues du réacteur
+void run_timers(Shard* shard) {
+    Timer* next;
+    for (Timer* timer = wheel_expire(&shard->wheel, shard->now); timer; timer = next) {
+        // Le traitement peut réarmer la temporisation, ce qui réutilise timer->next
+        next = timer->next;
+        ClientNode* client = timer->data;
+        if (client->closing) {
+            continue;
+        }
+        if (timer->kind == TIMER_CLIENT) {
+            client_timer_expired(shard, client);
+        } else if (timer->kind == TIMER_FILE_REQUEST) {
+            file_request_expired(client);
+        }
+    }
+}
+
+// Fonction pour écrire une famille de compteurs par type de message, additionnés sur les réacteurs
+// offset désigne le tableau de Metrics concerné ; les types jamais vus sont omis
+void write_type_counters(FILE* out, const char* name, const char* help, size_t offset) {
+    metrics_write_header(out, name, "counter", help);
+    for (size_t type = 0; type <= MSG_TYPE_COUNT; type++) {
+        unsigned long total = 0;
+        for (int i = 0; i < shard_count; i++) {
+            atomic_ulong* counters = (atomic_ulong*)((char*)&shards[i].metrics + offset);
+            total += counter_get(&counters[type]);
+        }
+        if (total > 0) {
+            fprintf(out, "%s{type=\"%s\"} %lu\n", name, type < MSG_TYPE_COUNT ? msg_type_str[type] : "UNKNOWN", total);
+        }
+    }
+}
 
-        pfds[0].fd = sfd;
-        pfds[0].events = POLLIN;
-        client_nodes[0] = NULL;
+// Fonction pour écrire une famille d'histogrammes par type de message, additionnés sur les réacteurs
+void write_type_histograms(FILE* out, const char* name, const char* help, size_t offset, int first, int last, double scale) {
+    metrics_write_header(out, name, "histogram", help);
+    for (size_t type = 0; type <= MSG_TYPE_COUNT; type++) {
+        unsigned long buckets[METRIC_HIST_BUCKETS] = {0};
+        unsigned long sum = 0;
+        bool seen = false;
+        for (int i = 0; i < shard_count; i++) {
+            Histogram* hists = (Histogram*)((char*)&shards[i].metrics + offset);
+            histogram_merge(buckets, &sum, &hists[type]);
+        }
+        for (int b = 0; b < METRIC_HIST_BUCKETS; b++) {
+            seen = seen || buckets[b] > 0;
+        }
+        if (seen) {
+            char labels[64];
+            snprintf(labels, sizeof(labels), "type=\"%s\"", type < MSG_TYPE_COUNT ? msg_type_str[type] : "UNKNOWN");
+            metrics_write_histogram(out, name, labels, buckets, sum, first, last, scale);
+        }
+    }
+}
+
+// Fonction pour écrire toutes les métriques du serveur au format texte de Prometheus
+void write_metrics(FILE* out) {
+    write_type_counters(out, "chat_messages_received_total", "Trames reçues des clients",
+                        offsetof(Metrics, received));
+    write_type_counters(out, "chat_bytes_received_total", "Octets reçus des clients, en-têtes compris",
+                        offsetof(Metrics, received_bytes));
+    write_type_counters(out, "chat_messages_sent_total", "Trames mises en file d'envoi vers les clients",
+                        offsetof(Metrics, sent));
+    write_type_counters(out, "chat_bytes_sent_total", "Octets mis en file d'envoi vers les clients",
+                        offsetof(Metrics, sent_bytes));
+    write_type_counters(out, "chat_messages_dropped_total", "Trames jetées par la politique des clients lents",
+                        offsetof(Metrics, dropped));
+    write_type_histograms(out, "chat_handling_seconds", "Temps de traitement d'une trame reçue",
+                          offsetof(Metrics, handling_ns), 7, 34, 1e-9);
+    write_type_histograms(out, "chat_fanout_recipients", "Nombre de destinataires d'une diffusion",
+                          offsetof(Metrics, fanout), 0, 20, 1);
+
+    unsigned long buckets[METRIC_HIST_BUCKETS] = {0};
+    unsigned long sum = 0;
+    unsigned long accepted = 0;
+    for (int i = 0; i < shard_count; i++) {
+        histogram_merge(buckets, &sum, &shards[i].metrics.queue_depth);
+        accepted += counter_get(&shards[i].metrics.accepted);
+    }
+    metrics_write_header(out, "chat_queue_bytes", "histogram", "Octets en file chez un destinataire après l'ajout d'une trame");
+    metrics_write_histogram(out, "chat_queue_bytes", "", buckets, sum, 6, 26, 1);
+    metrics_write_header(out, "chat_connections_accepted_total", "counter", "Connexions acceptées");
+    fprintf(out, "chat_connections_accepted_total %lu\n", accepted);
+
+    metrics_write_header(out, "chat_disconnects_total", "counter", "Connexions fermées, par motif");
+    for (int reason = 0; reason < CLOSE_REASON_COUNT; reason++) {
+        unsigned long total = 0;
+        for (int i = 0; i < shard_count; i++) {
+            total += counter_get(&shards[i].metrics.disconnects[reason]);
+        }
+        fprintf(out, "chat_disconnects_total{reason=\"%s\"} %lu\n", close_reason_str[reason], total);
+    }
+
+    int clients = atomic_load(&client_count);
+    pthread_mutex_lock(&channel_registry_lock);
+    size_t channels = channel_count;
+    pthread_mutex_unlock(&channel_registry_lock);
+    metrics_write_header(out, "chat_clients", "gauge", "Clients connectés");
+    fprintf(out, "chat_clients %d\n", clients);
+    metrics_write_header(out, "chat_channels", "gauge", "Salons existants");
+    fprintf(out, "chat_channels %zu\n", channels);
+
+    slab_write_metrics(out);
+    if (message_log_enabled) {
+        metrics_write_header(out, "chat_journal_records_total", "counter", "Messages écrits dans le journal");
+        fprintf(out, "chat_journal_records_total %lu\n", atomic_load(&message_log.appended));
+        metrics_write_header(out, "chat_journal_dropped_total", "counter", "Messages que le journal n'a pas pu écrire");
+        fprintf(out, "chat_journal_dropped_total %lu\n", atomic_load(&message_log.dropped));
+    }
+    metrics_write_header(out, "chat_traces_dropped_total", "counter", "Traces perdues faute de place dans leur file");
+    fprintf(out, "chat_traces_dropped_total %lu\n", atomic_load(&trace_dropped));
+}
+
+// Fonction pour servir les connexions en attente sur la socket d'administration
+// Le rendu tient en mémoire ; l'écriture est bloquante mais bornée par SO_SNDTIMEO
+void handle_admin_connection() {
+    while (1) {
+        int connfd = accept(admin_fd, NULL, NULL);
+        if (connfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept(admin)");
+            }
+            return;
+        }
+        struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+        setsockopt(connfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        char* text = NULL;
+        size_t len = 0;
+        FILE* out = open_memstream(&text, &len);
+        if (out) {
+            write_metrics(out);
+            fclose(out);
+            size_t sent = 0;
+            while (sent < len) {
+                ssize_t ret = send(connfd, text + sent, len - sent, MSG_NOSIGNAL);
+                if (ret <= 0) {
+                    break;
+                }
+                sent += ret;
+            }
+            free(text);
+        }
+        close(connfd);
+    }
+}
 
-        int idx = 1;
-        for (ClientNode* tmp = head; tmp && idx < MAX_CLIENTS + 1; tmp = tmp->next) {
-            pfds[idx] = tmp->pfd;
-            client_nodes[idx] = tmp;
-            idx++;
+// Boucle d'événements d'un réacteur (epoll)
+// Le coût d'un réveil dépend du nombre de sockets prêtes, pas du nombre de clients connectés
+void event_loop(Shard* shard) {
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event ev;
+    self_shard = shard;
+
+    // La socket d'écoute reste en mode level-triggered ; chaque réveil accepte toutes les connexions en attente
+    if (shard->listen_fd >= 0) {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if (epoll_ctl(shard->epfd, EPOLL_CTL_ADD, shard->listen_fd, &ev) == -1) {
+            perror("epoll_ctl(ADD)");
+            exit(EXIT_FAILURE);
+        }
+    }
+    // Le premier réacteur sert aussi la socket d'administration
+    if (shard->index == 0 && admin_fd >= 0) {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = &admin_fd;
+        if (epoll_ctl(shard->epfd, EPOLL_CTL_ADD, admin_fd, &ev) == -1) {
+            perror("epoll_ctl(ADD)");
+            exit(EXIT_FAILURE);
         }
+    }
+    // L'eventfd du réacteur signale du courrier dans sa boîte aux lettres
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = shard;
+    if (epoll_ctl(shard->epfd, EPOLL_CTL_ADD, shard->wake_fd, &ev) == -1) {
+        perror("epoll_ctl(ADD)");
+        exit(EXIT_FAILURE);
+    }
 
-        int active_fds = poll(pfds, idx, -1);
+    while (1) {
+        // Des clients fermés pendant le vidage de la boîte aux lettres attendent encore d'être libérés
+        int timeout = shard->closing_list ? 0 : wheel_next_timeout(&shard->wheel, now_ms());
+        int active_fds = epoll_wait(shard->epfd, events, MAX_EVENTS, timeout);
+        shard->now = now_ms();
+        if (stats_requested && shard->index == 0) {
+            stats_requested = 0;
+            slab_print_stats(stdout);
+            if (message_log_enabled) {
+                printf("journal  %lu enregistrements, %lu abandonnés\n", atomic_load(&message_log.appended), atomic_load(&message_log.dropped));
+            }
+            fflush(stdout);
+        }
         if (active_fds == -1) {
-            perror("poll()");
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait()");
             exit(EXIT_FAILURE);
         }
 
-        for (int i = 0; i < idx && active_fds > 0; i++) {
-            if (pfds[i].revents & POLLIN) {
-                if (pfds[i].fd == sfd) {
-                    handle_new_connection(sfd);
-                } else {
-                    echo_server(client_nodes[i]);
+        for (int i = 0; i < active_fds; i++) {
+            if (events[i].data.ptr == NULL) {
+                handle_new_connection(shard->listen_fd);
+                continue;
+            }
+            if (events[i].data.ptr == &admin_fd) {
+                handle_admin_connection();
+                continue;
+            }
+            if (events[i].data.ptr == shard) {
+                uint64_t count;
+                if (read(shard->wake_fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+                    perror("read(eventfd)");
                 }
-                active_fds--;
-            } else if (pfds[i].revents & (POLLERR | POLLHUP)) {
-                close(pfds[i].fd);
-                remove_client(client_nodes[i]);
-                active_fds--;
+                atomic_store(&shard->wake_pending, 0);
+                shard_drain_mailbox(shard);
+                continue;
+            }
+            ClientNode* client = events[i].data.ptr;
+            if (events[i].events & EPOLLIN) {
+                // Les données en attente sont lues avant de traiter un éventuel EPOLLRDHUP
+                drain_client(client);
+            } else if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                close_client(client, CLOSE_PEER);
+            }
+            if ((events[i].events & EPOLLOUT) && !client->closing && flush_client(client) < 0) {
+                close_client(client, CLOSE_ERROR);
             }
         }
+        run_timers(shard);
+        reap_closed_clients();
+    }
+}
+
+// Point d'entrée des threads des réacteurs secondaires
+void* shard_thread(void* arg) {
+    event_loop(arg);
+    return NULL;
+}
+
+// Fonction appelée à la réception de SIGUSR1 : demande l'affichage des statistiques mémoire
+void request_stats(int sig) {
+    (void)sig;
+    stats_requested = 1;
+}
+
+// Fonction pour créer les réacteurs ; le premier tourne sur le thread principal
+void init_shards() {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    // Sans préférence pour les écrivains, un flot continu de messages affamerait les connexions et /join
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    for (int i = 0; i < DIRECTORY_SHARDS; i++) {
+        pthread_rwlock_init(&nick_shards[i].lock, &attr);
+        pthread_rwlock_init(&channel_shards[i].lock, &attr);
+    }
+    pthread_rwlockattr_destroy(&attr);
+
+    shards = calloc(shard_count, sizeof(Shard));
+    if (!shards) {
+        perror("Échec d'allocation mémoire pour les réacteurs");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < shard_count; i++) {
+        shards[i].index = i;
+        shards[i].listen_fd = -1;
+        shards[i].epfd = epoll_create1(0);
+        if (shards[i].epfd == -1) {
+            perror("epoll_create1()");
+            exit(EXIT_FAILURE);
+        }
+        shards[i].wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (shards[i].wake_fd == -1) {
+            perror("eventfd()");
+            exit(EXIT_FAILURE);
+        }
+        atomic_init(&shards[i].wake_pending, 0);
+        shards[i].now = now_ms();
+        wheel_init(&shards[i].wheel, shards[i].now);
+        mailbox_init(&shards[i].mailbox);
+    }
+}
+
+// Fonction pour relever la limite de descripteurs ouverts au maximum autorisé
+void raise_fd_limit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) == -1) {
+            perror("setrlimit()");
+        }
+    }
+}
+
+// Fonction pour activer le journal des messages dans le dossier dir ; quitte en cas d'échec
+// Les segments laissés par une exécution précédente sont relus pour reconstruire l'index des salons
+void enable_message_log(const char* dir) {
+    if (seglog_open(&message_log, dir, log_keep_segments) == -1) {
+        fprintf(stderr, "Impossible d'ouvrir le journal des messages dans %s\n", dir);
+        exit(EXIT_FAILURE);
+    }
+    message_log_enabled = true;
+    log_index_rebuild();
+}
+
+// Fonction pour lancer les traces au niveau nommé (error, warn, info ou debug) ; -1 si le nom est inconnu
+// Les événements liés à chaque message ne sont gardés qu'un sur sample_rate
+int enable_traces(const char* level_name, unsigned int sample_rate) {
+    static const char* names[] = {"error", "warn", "info", "debug"};
+    for (int level = TRACE_ERROR; level <= TRACE_DEBUG; level++) {
+        if (strcmp(level_name, names[level]) == 0) {
+            trace_start(stdout, level, sample_rate);
+            return 0;
+        }
     }
+    return -1;
 }
 
+#ifndef CHAT_NO_MAIN
 // Fonction principale du serveur
+// Sans point d'entrée quand le fichier est inclus par microbench.c
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Utilisatioon : %s <port_serveur>\n", argv[0]);
-        exit(EXIT_FAILURE);
+    static const struct option long_options[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"reuseport", no_argument, NULL, 'r'},
+        {"keepalive", required_argument, NULL, 'k'},
+        {"idle-timeout", required_argument, NULL, 'i'},
+        {"history", required_argument, NULL, 'H'},
+        {"log-dir", required_argument, NULL, 'L'},
+        {"log-keep", required_argument, NULL, 'K'},
+        {"admin", required_argument, NULL, 'A'},
+        {"log-level", required_argument, NULL, 'l'},
+        {"log-sample", required_argument, NULL, 's'},
+        {NULL, 0, NULL, 0},
+    };
+    const char* trace_level_name = "info";
+    unsigned int trace_sample = 1;
+    const char* log_dir = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "q:p:t:rk:i:H:L:K:A:l:s:", long_options, NULL)) != -1) {
+        if (opt == 'q' && atol(optarg) > 0) {
+            max_queue_bytes = atol(optarg);
+        } else if (opt == 'p' && strcmp(optarg, "drop") == 0) {
+            slow_consumer_policy = SLOW_DROP;
+        } else if (opt == 'p' && strcmp(optarg, "disconnect") == 0) {
+            slow_consumer_policy = SLOW_DISCONNECT;
+        } else if (opt == 'p' && strcmp(optarg, "coalesce") == 0) {
+            slow_consumer_policy = SLOW_COALESCE;
+        } else if (opt == 't' && atoi(optarg) > 0) {
+            shard_count = atoi(optarg);
+        } else if (opt == 'r') {
+            reuseport_listeners = true;
+        } else if (opt == 'k' && atoi(optarg) > 0) {
+            keepalive_ms = atoi(optarg) * 1000LL;
+        } else if (opt == 'i' && atoi(optarg) > 0) {
+            idle_timeout_ms = atoi(optarg) * 1000LL;
+        } else if (opt == 'H' && atoi(optarg) >= 0) {
+            history_replay = atoi(optarg) < CHANNEL_HISTORY_LEN ? atoi(optarg) : CHANNEL_HISTORY_LEN;
+        } else if (opt == 'L') {
+            log_dir = optarg;
+        } else if (opt == 'K' && atoi(optarg) > 0 && atoi(optarg) <= SEGLOG_MAX_KEEP) {
+            log_keep_segments = atoi(optarg);
+        } else if (opt == 'A') {
+            open_admin_socket(optarg);
+        } else if (opt == 'l') {
+            trace_level_name = optarg;
+        } else if (opt == 's' && atoi(optarg) > 0) {
+            trace_sample = atoi(optarg);
+        } else {
+            optind = argc + 1;
+            break;
+        }
     }
-    int sfd = handle_bind(argv[1]);
-    
-    if (listen(sfd, SOMAXCONN) != 0) {
-        perror("listen()\n");
+    if (optind != argc - 1 || enable_traces(trace_level_name, trace_sample) == -1) {
+        fprintf(stderr, "Utilisation : %s [-q octets_max_file] [-p drop|disconnect|coalesce] [--threads N] [--reuseport] [--keepalive s] [--idle-timeout s] [--history N] [--log-dir dossier] [--log-keep segments] [--admin socket] [--log-level error|warn|info|debug] [--log-sample N] <port_serveur>\n", argv[0]);
         exit(EXIT_FAILURE);
     }
+    if (log_dir) {
+        enable_message_log(log_dir);
+    }
+    raise_fd_limit();
+    init_shards();
+
+    // Par défaut, le premier réacteur accepte et répartit les clients ; avec --reuseport,
+    // chaque réacteur écoute sur sa propre socket et le noyau répartit les connexions
+    for (int i = 0; i < shard_count; i++) {
+        if (i == 0 || reuseport_listeners) {
+            shards[i].listen_fd = open_listener(argv[optind], reuseport_listeners);
+        }
+    }
+    // SIGUSR1 affiche les statistiques de l'allocateur ; seul le premier réacteur le reçoit,
+    // sans SA_RESTART pour que son epoll_wait() soit interrompu
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = request_stats;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+    sigset_t usr1;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &usr1, NULL);
+    for (int i = 1; i < shard_count; i++) {
+        if (pthread_create(&shards[i].thread, NULL, shard_thread, &shards[i]) != 0) {
+            perror("pthread_create()");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_sigmask(SIG_UNBLOCK, &usr1, NULL);
 
-    poll_loop(sfd);
-    close(sfd);
+    event_loop(&shards[0]);
     exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+}
+#endif
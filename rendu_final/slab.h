@@ -0,0 +1,195 @@
+//slab.h
+// Allocateur par classes de taille pour les objets du serveur (clients, trames, anneaux, messages)
+// Chaque classe découpe des blocs de SLAB_CHUNK_SIZE octets obtenus une fois pour toutes du système ;
+// les objets libérés retournent dans une liste libre et ne sont jamais rendus à malloc.
+// Chaque thread garde un petit cache par classe ; les échanges avec la réserve commune
+// (protégée par un verrou) se font par lots de SLAB_BATCH objets.
+// La taille de l'objet est redonnée à slab_free() : aucun en-tête par objet.
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SLAB_CHUNK_SIZE (64 * 1024)
+#define SLAB_BATCH 32
+#define SLAB_CLASS_COUNT 10
+
+typedef struct SlabObject {
+    struct SlabObject* next;
+} SlabObject;
+
+typedef struct SlabClass {
+    size_t size;
+    pthread_mutex_t lock;
+    SlabObject* free;
+    size_t free_count;
+    size_t chunks;
+    atomic_long in_use;
+    atomic_ulong allocs;
+} SlabClass;
+
+typedef struct SlabCache {
+    SlabObject* free;
+    unsigned int count;
+} SlabCache;
+
+static SlabClass slab_classes[SLAB_CLASS_COUNT] = {
+    {.size = 32, .lock = PTHREAD_MUTEX_INITIALIZER},
+    {.size = 64, .lock = PTHREAD_MUTEX_INITIALIZER},
+    {.size = 128, .lock = PTHREAD_MUTEX_INITIALIZER},
+    {.size = 256, .lock = PTHREAD_MUTEX_INITIALIZER},
+    {.size = 512, .lock = PTHREAD_MUTEX_INITIALIZER},
+    {.size = 768, .lock = PTHREAD_MUTEX_INITIALIZER},
+    {.size = 1024, .lock = PTHREAD_MUTEX_INITIALIZER},
+    {.size = 1536, .lock = PTHREAD_MUTEX_INITIALIZER},
+    {.size = 2048, .lock = PTHREAD_MUTEX_INITIALIZER},
+    {.size = 4096, .lock = PTHREAD_MUTEX_INITIALIZER},
+};
+static __thread SlabCache slab_caches[SLAB_CLASS_COUNT];
+// Objets trop grands pour les classes : confiés directement à malloc
+static atomic_ulong slab_large_allocs;
+static atomic_long slab_large_in_use;
+
+// Fonction pour trouver la plus petite classe qui contient size octets ; -1 si aucune
+static int slab_class_of(size_t size) {
+    for (int c = 0; c < SLAB_CLASS_COUNT; c++) {
+        if (size <= slab_classes[c].size) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+// Fonction pour remplir le cache du thread depuis la réserve, en découpant un nouveau bloc si besoin
+static void slab_refill(SlabClass* class, SlabCache* cache) {
+    pthread_mutex_lock(&class->lock);
+    if (!class->free) {
+        char* chunk = malloc(SLAB_CHUNK_SIZE);
+        if (!chunk) {
+            perror("Échec d'allocation mémoire pour un bloc de l'allocateur");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t off = 0; off + class->size <= SLAB_CHUNK_SIZE; off += class->size) {
+            SlabObject* obj = (SlabObject*)(chunk + off);
+            obj->next = class->free;
+            class->free = obj;
+            class->free_count++;
+        }
+        class->chunks++;
+    }
+    while (class->free && cache->count < SLAB_BATCH) {
+        SlabObject* obj = class->free;
+        class->free = obj->next;
+        class->free_count--;
+        obj->next = cache->free;
+        cache->free = obj;
+        cache->count++;
+    }
+    pthread_mutex_unlock(&class->lock);
+}
+
+// Fonction pour rendre un lot d'objets du cache du thread à la réserve
+static void slab_drain(SlabClass* class, SlabCache* cache) {
+    pthread_mutex_lock(&class->lock);
+    for (int i = 0; i < SLAB_BATCH && cache->free; i++) {
+        SlabObject* obj = cache->free;
+        cache->free = obj->next;
+        cache->count--;
+        obj->next = class->free;
+        class->free = obj;
+        class->free_count++;
+    }
+    pthread_mutex_unlock(&class->lock);
+}
+
+// Fonction pour allouer size octets (non initialisés)
+static void* slab_alloc(size_t size) {
+    int c = slab_class_of(size);
+    if (c < 0) {
+        void* ptr = malloc(size);
+        if (!ptr) {
+            perror("Échec d'allocation mémoire");
+            exit(EXIT_FAILURE);
+        }
+        atomic_fetch_add_explicit(&slab_large_allocs, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&slab_large_in_use, 1, memory_order_relaxed);
+        return ptr;
+    }
+
+    SlabClass* class = &slab_classes[c];
+    SlabCache* cache = &slab_caches[c];
+    if (!cache->free) {
+        slab_refill(class, cache);
+    }
+    SlabObject* obj = cache->free;
+    cache->free = obj->next;
+    cache->count--;
+    atomic_fetch_add_explicit(&class->allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&class->in_use, 1, memory_order_relaxed);
+    return obj;
+}
+
+// Fonction pour libérer un objet de size octets obtenu par slab_alloc(size) ; ptr peut être NULL
+static void slab_free(void* ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+    int c = slab_class_of(size);
+    if (c < 0) {
+        atomic_fetch_sub_explicit(&slab_large_in_use, 1, memory_order_relaxed);
+        free(ptr);
+        return;
+    }
+
+    SlabClass* class = &slab_classes[c];
+    SlabCache* cache = &slab_caches[c];
+    SlabObject* obj = ptr;
+    obj->next = cache->free;
+    cache->free = obj;
+    cache->count++;
+    atomic_fetch_sub_explicit(&class->in_use, 1, memory_order_relaxed);
+    if (cache->count > 2 * SLAB_BATCH) {
+        slab_drain(class, cache);
+    }
+}
+
+// Fonction pour écrire les statistiques de l'allocateur, une ligne par classe
+static void slab_print_stats(FILE* out) {
+    fprintf(out, "slab  taille  blocs  utilisés  réserve  allocations\n");
+    for (int c = 0; c < SLAB_CLASS_COUNT; c++) {
+        SlabClass* class = &slab_classes[c];
+        pthread_mutex_lock(&class->lock);
+        size_t chunks = class->chunks;
+        size_t free_count = class->free_count;
+        pthread_mutex_unlock(&class->lock);
+        fprintf(out, "slab  %6zu  %5zu  %8ld  %7zu  %lu\n", class->size, chunks,
+                atomic_load(&class->in_use), free_count, atomic_load(&class->allocs));
+    }
+    fprintf(out, "slab  malloc  %ld utilisés, %lu allocations\n",
+            atomic_load(&slab_large_in_use), atomic_load(&slab_large_allocs));
+}
+
+// Fonction pour écrire les mêmes statistiques au format texte de Prometheus (socket d'administration)
+static void slab_write_metrics(FILE* out) {
+    fprintf(out, "# HELP chat_slab_objects_in_use Objets alloués et non libérés, par classe de taille\n"
+                 "# TYPE chat_slab_objects_in_use gauge\n");
+    for (int c = 0; c < SLAB_CLASS_COUNT; c++) {
+        fprintf(out, "chat_slab_objects_in_use{size=\"%zu\"} %ld\n", slab_classes[c].size, atomic_load(&slab_classes[c].in_use));
+    }
+    fprintf(out, "chat_slab_objects_in_use{size=\"malloc\"} %ld\n", atomic_load(&slab_large_in_use));
+    fprintf(out, "# HELP chat_slab_allocations_total Allocations servies, par classe de taille\n"
+                 "# TYPE chat_slab_allocations_total counter\n");
+    for (int c = 0; c < SLAB_CLASS_COUNT; c++) {
+        fprintf(out, "chat_slab_allocations_total{size=\"%zu\"} %lu\n", slab_classes[c].size, atomic_load(&slab_classes[c].allocs));
+    }
+    fprintf(out, "chat_slab_allocations_total{size=\"malloc\"} %lu\n", atomic_load(&slab_large_allocs));
+    fprintf(out, "# HELP chat_slab_chunks Blocs demandés au système, par classe de taille\n"
+                 "# TYPE chat_slab_chunks gauge\n");
+    for (int c = 0; c < SLAB_CLASS_COUNT; c++) {
+        SlabClass* class = &slab_classes[c];
+        pthread_mutex_lock(&class->lock);
+        size_t chunks = class->chunks;
+        pthread_mutex_unlock(&class->lock);
+        fprintf(out, "chat_slab_chunks{size=\"%zu\"} %zu\n", class->size, chunks);
+    }
+}
@@ -0,0 +1,201 @@
+//trace.h
+// Traces du serveur, écrites par un thread dédié pour que les boucles d'événements ne bloquent
+// jamais sur la sortie standard (tube plein, terminal lent).
+// Une trace est un enregistrement de taille fixe dans un anneau sans verrou à plusieurs producteurs
+// (un numéro de séquence par case) : le format (une chaîne littérale), au plus deux chaînes copiées,
+// un entier et l'heure brute en nanosecondes. Le formatage n'a lieu que dans le thread d'écriture ;
+// le format n'accepte que %s (chaînes, dans l'ordre) et les conversions entières (l'entier).
+// Anneau plein : la trace est perdue et comptée, l'appelant n'attend jamais.
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_RING_SIZE 4096
+// Taille des chaînes copiées : un enregistrement tient dans deux lignes de cache
+#define TRACE_STR_LEN 40
+// Pause du thread d'écriture entre deux passages : courte juste après des traces, puis doublée
+// à chaque passage à vide jusqu'à TRACE_POLL_MAX_NS. Il ne relit jamais l'anneau en boucle serrée,
+// ce qui volerait aux producteurs les lignes de cache des cases qu'ils remplissent.
+#define TRACE_POLL_MIN_NS 50000L
+#define TRACE_POLL_MAX_NS 5000000L
+
+enum trace_level {
+    TRACE_ERROR,
+    TRACE_WARN,
+    TRACE_INFO,
+    TRACE_DEBUG,
+};
+
+static const char* trace_level_str[] = {"ERREUR", "ALERTE", "INFO", "DEBUG"};
+
+typedef struct __attribute__((aligned(64))) TraceRecord {
+    // Vaut la position + 1 quand la trace est publiée, la position + TRACE_RING_SIZE quand la case est libérée
+    atomic_ulong seq;
+    long long time_ns;
+    const char* format;
+    long long number;
+    int level;
+    char str[2][TRACE_STR_LEN];
+} TraceRecord;
+
+static TraceRecord trace_ring[TRACE_RING_SIZE];
+static atomic_ulong trace_head;
+static unsigned long trace_tail;
+static atomic_ulong trace_dropped;
+// Niveau au-delà duquel les traces sont ignorées ; -1 tant que le thread d'écriture n'est pas lancé
+static int trace_level = -1;
+// Un événement par message sur trace_sample_rate est gardé (compté par thread)
+static unsigned int trace_sample_rate = 1;
+static pthread_t trace_thread;
+static atomic_bool trace_stopping;
+
+// Fonction pour copier une chaîne dans une trace, tronquée à TRACE_STR_LEN - 1 caractères
+// memccpy() s'arrête au '\0' : rien n'est lu au-delà de la chaîne, même d'un tableau plus court
+static inline void trace_copy(char* dst, const char* src) {
+    if (!src || !memccpy(dst, src, '\0', TRACE_STR_LEN - 1)) {
+        dst[src ? TRACE_STR_LEN - 1 : 0] = '\0';
+    }
+}
+
+// Fonction pour publier une trace ; sans effet si level dépasse le niveau choisi
+static inline void trace_event(int level, const char* format, const char* s1, const char* s2, long long number) {
+    if (level > trace_level) {
+        return;
+    }
+    unsigned long pos = atomic_load_explicit(&trace_head, memory_order_relaxed);
+    TraceRecord* rec;
+    while (1) {
+        rec = &trace_ring[pos & (TRACE_RING_SIZE - 1)];
+        long diff = (long)(atomic_load_explicit(&rec->seq, memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&trace_head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&trace_dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&trace_head, memory_order_relaxed);
+        }
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rec->time_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    rec->format = format;
+    rec->number = number;
+    rec->level = level;
+    trace_copy(rec->str[0], s1);
+    trace_copy(rec->str[1], s2);
+    atomic_store_explicit(&rec->seq, pos + 1, memory_order_release);
+}
+
+// Fonction pour publier une trace liée à un message : seule une sur trace_sample_rate est gardée
+static inline void trace_sampled(int level, const char* format, const char* s1, const char* s2, long long number) {
+    static __thread unsigned int tick;
+    if (level > trace_level || ++tick < trace_sample_rate) {
+        return;
+    }
+    tick = 0;
+    trace_event(level, format, s1, s2, number);
+}
+
+// Fonction pour formater une trace (thread d'écriture) ; l'heure est remise en forme une fois par seconde
+static void trace_format(FILE* out, const TraceRecord* rec) {
+    static time_t cached_sec = -1;
+    static char cached_date[32];
+    time_t sec = rec->time_ns / 1000000000LL;
+    if (sec != cached_sec) {
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        strftime(cached_date, sizeof(cached_date), "%Y-%m-%d %H:%M:%S", &tm);
+        cached_sec = sec;
+    }
+    fprintf(out, "%s.%06lld %-6s ", cached_date, rec->time_ns % 1000000000LL / 1000, trace_level_str[rec->level]);
+
+    int next_str = 0;
+    for (const char* p = rec->format; *p; p++) {
+        if (*p != '%') {
+            fputc(*p, out);
+            continue;
+        }
+        p++;
+        while (*p == 'l' || *p == 'z' || *p == 'h') {
+            p++;
+        }
+        if (*p == 's') {
+            fputs(next_str < 2 ? rec->str[next_str++] : "", out);
+        } else if (*p == '%') {
+            fputc('%', out);
+        } else if (*p) {
+            fprintf(out, "%lld", rec->number);
+        } else {
+            break;
+        }
+    }
+    fputc('\n', out);
+}
+
+// Fonction pour écrire toutes les traces publiées ; retourne leur nombre
+static int trace_drain(FILE* out) {
+    static unsigned long reported_drops;
+    int count = 0;
+    while (1) {
+        TraceRecord* rec = &trace_ring[trace_tail & (TRACE_RING_SIZE - 1)];
+        if (atomic_load_explicit(&rec->seq, memory_order_acquire) != trace_tail + 1) {
+            break;
+        }
+        trace_format(out, rec);
+        atomic_store_explicit(&rec->seq, trace_tail + TRACE_RING_SIZE, memory_order_release);
+        trace_tail++;
+        count++;
+    }
+    unsigned long drops = atomic_load_explicit(&trace_dropped, memory_order_relaxed);
+    if (drops != reported_drops) {
+        fprintf(out, "%lu traces perdues (file des traces pleine)\n", drops - reported_drops);
+        reported_drops = drops;
+        count++;
+    }
+    return count;
+}
+
+// Thread d'écriture des traces : vide l'anneau par lots, avec une pause entre deux passages
+static void* trace_writer(void* arg) {
+    FILE* out = arg;
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = TRACE_POLL_MIN_NS};
+    while (1) {
+        bool stopping = atomic_load(&trace_stopping);
+        if (trace_drain(out) > 0) {
+            fflush(out);
+            pause.tv_nsec = TRACE_POLL_MIN_NS;
+        } else if (stopping) {
+            return NULL;
+        } else {
+            pause.tv_nsec = pause.tv_nsec * 2 < TRACE_POLL_MAX_NS ? pause.tv_nsec * 2 : TRACE_POLL_MAX_NS;
+        }
+        nanosleep(&pause, NULL);
+    }
+}
+
+// Fonction pour vider les traces restantes et arrêter le thread d'écriture (appelée par exit())
+static void trace_stop() {
+    atomic_store(&trace_stopping, true);
+    pthread_join(trace_thread, NULL);
+}
+
+// Fonction pour lancer le thread d'écriture des traces vers out, au niveau level
+static void trace_start(FILE* out, int level, unsigned int sample_rate) {
+    for (unsigned long i = 0; i < TRACE_RING_SIZE; i++) {
+        atomic_init(&trace_ring[i].seq, i);
+    }
+    trace_sample_rate = sample_rate > 0 ? sample_rate : 1;
+    if (pthread_create(&trace_thread, NULL, trace_writer, out) != 0) {
+        perror("pthread_create(traces)");
+        return;
+    }
+    trace_level = level;
+    atexit(trace_stop);
+}
@@ -0,0 +1,182 @@
+//wheel.h
+// Roue de temporisation hiérarchique (même principe que les anciens timers du noyau Linux) :
+//   niveau 0     : 256 cases d'un tick
+//   niveaux 1-3  : 64 cases chacun, de 256, 16384 et 1048576 ticks
+// Armer et désarmer coûtent O(1) ; chaque tick ne visite qu'une case du niveau 0.
+// Quand le niveau 0 a fait un tour, la case suivante du niveau 1 est redistribuée
+// plus bas (cascade), et ainsi de suite : aucun parcours de l'ensemble des temporisations.
+#include <stdbool.h>
+#include <string.h>
+
+#define WHEEL_TICK_MS 100
+#define WHEEL_L0_BITS 8
+#define WHEEL_LN_BITS 6
+#define WHEEL_UPPER_LEVELS 3
+#define WHEEL_L0_SIZE (1UL << WHEEL_L0_BITS)
+#define WHEEL_LN_SIZE (1UL << WHEEL_LN_BITS)
+#define WHEEL_L0_MASK (WHEEL_L0_SIZE - 1)
+#define WHEEL_LN_MASK (WHEEL_LN_SIZE - 1)
+// Échéance la plus lointaine représentable (environ 77 jours) ; au-delà, elle est ramenée à cette limite
+#define WHEEL_MAX_TICKS (1UL << (WHEEL_L0_BITS + WHEEL_UPPER_LEVELS * WHEEL_LN_BITS))
+
+// Temporisation ; kind et data permettent à l'appelant de retrouver quoi faire à l'échéance
+typedef struct Timer {
+    struct Timer* prev;
+    struct Timer* next;
+    struct Timer** slot;
+    unsigned long expires;
+    bool armed;
+    int kind;
+    void* data;
+} Timer;
+
+typedef struct TimerWheel {
+    long long origin_ms;
+    unsigned long current;
+    size_t armed;
+    Timer* level0[WHEEL_L0_SIZE];
+    Timer* upper[WHEEL_UPPER_LEVELS][WHEEL_LN_SIZE];
+} TimerWheel;
+
+// Fonction pour initialiser une roue vide ; le tick 0 correspond à now_ms
+static void wheel_init(TimerWheel* wheel, long long now_ms) {
+    memset(wheel, 0, sizeof(TimerWheel));
+    wheel->origin_ms = now_ms;
+}
+
+// Fonction pour ranger une temporisation dans la case de son échéance
+static void wheel_place(TimerWheel* wheel, Timer* timer) {
+    unsigned long delta = timer->expires - wheel->current;
+    Timer** slot;
+
+    if (delta < WHEEL_L0_SIZE) {
+        slot = &wheel->level0[timer->expires & WHEEL_L0_MASK];
+    } else {
+        if (delta >= WHEEL_MAX_TICKS) {
+            timer->expires = wheel->current + WHEEL_MAX_TICKS - 1;
+            delta = WHEEL_MAX_TICKS - 1;
+        }
+        int level = 0;
+        while (delta >= 1UL << (WHEEL_L0_BITS + (level + 1) * WHEEL_LN_BITS)) {
+            level++;
+        }
+        int shift = WHEEL_L0_BITS + level * WHEEL_LN_BITS;
+        slot = &wheel->upper[level][(timer->expires >> shift) & WHEEL_LN_MASK];
+    }
+
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot) {
+        (*slot)->prev = timer;
+    }
+    *slot = timer;
+}
+
+// Fonction pour retirer une temporisation de sa case
+static void wheel_unlink(Timer* timer) {
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        *timer->slot = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->slot = NULL;
+}
+
+// Fonction pour désarmer une temporisation ; sans effet si elle ne l'est pas
+static void timer_cancel(TimerWheel* wheel, Timer* timer) {
+    if (!timer->armed) {
+        return;
+    }
+    wheel_unlink(timer);
+    timer->armed = false;
+    wheel->armed--;
+}
+
+// Fonction pour (ré)armer une temporisation delay_ms après now_ms
+// L'échéance est arrondie au tick supérieur : une temporisation n'expire jamais en avance
+static void timer_arm(TimerWheel* wheel, Timer* timer, long long delay_ms, long long now_ms) {
+    timer_cancel(wheel, timer);
+
+    long long at = now_ms + (delay_ms > 0 ? delay_ms : 0) - wheel->origin_ms;
+    unsigned long expires = at > 0 ? (unsigned long)((at + WHEEL_TICK_MS - 1) / WHEEL_TICK_MS) : 0;
+    if (expires < wheel->current) {
+        expires = wheel->current;
+    }
+    timer->expires = expires;
+    timer->armed = true;
+    wheel->armed++;
+    wheel_place(wheel, timer);
+}
+
+// Fonction pour redistribuer une case d'un niveau supérieur dans les niveaux inférieurs
+static void wheel_cascade(TimerWheel* wheel, int level, unsigned long index) {
+    Timer* timer = wheel->upper[level][index];
+    wheel->upper[level][index] = NULL;
+    while (timer) {
+        Timer* next = timer->next;
+        wheel_place(wheel, timer);
+        timer = next;
+    }
+}
+
+// Fonction pour faire avancer la roue jusqu'à now_ms
+// Retourne la liste (chaînée par next) des temporisations échues, déjà désarmées
+static Timer* wheel_expire(TimerWheel* wheel, long long now_ms) {
+    Timer* expired = NULL;
+    if (now_ms < wheel->origin_ms) {
+        return NULL;
+    }
+    unsigned long target = (unsigned long)((now_ms - wheel->origin_ms) / WHEEL_TICK_MS);
+
+    while (wheel->current <= target) {
+        if (wheel->armed == 0) {
+            // Rien d'armé : inutile de parcourir les ticks un par un
+            wheel->current = target + 1;
+            break;
+        }
+        if ((wheel->current & WHEEL_L0_MASK) == 0) {
+            for (int level = 0; level < WHEEL_UPPER_LEVELS; level++) {
+                unsigned long index = (wheel->current >> (WHEEL_L0_BITS + level * WHEEL_LN_BITS)) & WHEEL_LN_MASK;
+                wheel_cascade(wheel, level, index);
+                if (index != 0) {
+                    break;
+                }
+            }
+        }
+
+        Timer** slot = &wheel->level0[wheel->current & WHEEL_L0_MASK];
+        while (*slot) {
+            Timer* timer = *slot;
+            wheel_unlink(timer);
+            timer->armed = false;
+            wheel->armed--;
+            timer->next = expired;
+            expired = timer;
+        }
+        wheel->current++;
+    }
+    return expired;
+}
+
+// Fonction pour calculer le délai (en ms) avant le prochain tick qui a du travail
+// Retourne -1 si rien n'est armé ; les niveaux supérieurs ne sont examinés qu'à la prochaine cascade
+static int wheel_next_timeout(TimerWheel* wheel, long long now_ms) {
+    if (wheel->armed == 0) {
+        return -1;
+    }
+    unsigned long next = (wheel->current + WHEEL_L0_MASK) & ~WHEEL_L0_MASK;
+    for (unsigned long tick = wheel->current; tick < next; tick++) {
+        if (wheel->level0[tick & WHEEL_L0_MASK]) {
+            next = tick;
+            break;
+        }
+    }
+    long long delay = wheel->origin_ms + (long long)next * WHEEL_TICK_MS - now_ms;
+    return delay > 0 ? (int)delay : 0;
+}
@@ -0,0 +1,92 @@
+//wire.h
+// Échanges bloquants au format historique : une struct message, suivie de sa charge utile éventuelle.
+// Partagés par le client, microbench et idletest ; le serveur, non bloquant, passe par ses files d'envoi.
+// Un message part en un seul writev, en-tête et charge utile ensemble.
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Fonction pour écrire entièrement les iovcnt tampons de iov, en un seul writev si possible
+// iov est modifié en cas d'écriture partielle
+static ssize_t writev_all(int fd, struct iovec* iov, int iovcnt) {
+    ssize_t total_sent = 0;
+    while (iovcnt > 0) {
+        ssize_t ret = writev(fd, iov, iovcnt);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("writev");
+            return -1;
+        }
+        total_sent += ret;
+        while (iovcnt > 0 && (size_t)ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+    return total_sent;
+}
+
+// Fonction pour lire exactement len octets ; -1 en cas d'erreur ou si le pair ferme la connexion avant
+static ssize_t read_all(int fd, char* buf, size_t len) {
+    size_t total_received = 0;
+    while (total_received != len) {
+        ssize_t ret = read(fd, buf + total_received, len - total_received);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            return -1;
+        }
+        if (ret == 0) {
+            return -1;
+        }
+        total_received += ret;
+    }
+    return total_received;
+}
+
+// Fonction pour envoyer un message au format historique
+// La charge utile (msg->pld_len octets) n'est envoyée que si payload n'est pas NULL
+static ssize_t send_legacy_message(int fd, struct message* msg, const char* payload) {
+    size_t payload_len = (msg->pld_len > 0 && payload != NULL) ? msg->pld_len : 0;
+    struct iovec iov[2];
+    iov[0].iov_base = msg;
+    iov[0].iov_len = sizeof(struct message);
+    iov[1].iov_base = (char*)payload;
+    iov[1].iov_len = payload_len;
+    return writev_all(fd, iov, payload_len > 0 ? 2 : 1);
+}
+
+// Fonction pour recevoir un message au format historique
+// La charge utile n'est lue que si has_payload(type) le dit (toujours si has_payload est NULL) ;
+// elle est terminée par '\0' dans payload, de payload_size octets
+// Retourne le nombre d'octets lus, ou -1 en cas d'erreur ou de fermeture de la connexion
+static ssize_t receive_legacy_message(int fd, struct message* msg, char* payload, size_t payload_size,
+                                      bool (*has_payload)(enum msg_type)) {
+    payload[0] = '\0';
+    ssize_t total_received = read_all(fd, (char*)msg, sizeof(struct message));
+    if (total_received == -1) {
+        return -1;
+    }
+    msg->nick_sender[NICK_LEN - 1] = '\0';
+    msg->infos[INFOS_LEN - 1] = '\0';
+
+    if (msg->pld_len > 0 && (!has_payload || has_payload(msg->type))) {
+        if ((size_t)msg->pld_len >= payload_size || read_all(fd, payload, msg->pld_len) == -1) {
+            return -1;
+        }
+        payload[msg->pld_len] = '\0';
+        total_received += msg->pld_len;
+    }
+    return total_received;
+}